@@ -2,12 +2,13 @@
 #include "./deps/SOIL/SOIL.h"
 #include "./glad/include/glad/glad.h"
 
+#include <float.h>
+#include <limits.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define calloc_one(s) calloc(1, s)
 #define BUFFER_COUNT 2
 #define HAS_FLAG(batch, flag) ((batch->flags & flag) == flag)
 
@@ -62,15 +63,337 @@
 		}                                                              \
 	} while (0);
 
+/* Memory management */
+static size_t __memoryUsage[MEMORY_CATEGORY_COUNT];
+
+#ifdef BLZ_CONFIG_STATIC
+/* Static pools hand out fixed-size items from arrays sized at compile time,
+ * the free items are linked through their first bytes */
+struct StaticPool
+{
+	unsigned char *items;
+	size_t item_size;
+	int capacity;
+	/* count of items which were handed out at least once */
+	int used;
+	void *free_items;
+	enum BLZ_MemoryCategory category;
+};
+
+#define STATIC_POOL(name, type, count, category) \
+	static type name##Items[count];               \
+	static struct StaticPool name = {             \
+		(unsigned char *)name##Items, sizeof(type), count, 0, NULL, category};
+
+static void *pool_alloc(struct StaticPool *pool)
+{
+	void *item = pool->free_items;
+	if (item != NULL)
+	{
+		memcpy(&pool->free_items, item, sizeof(void *));
+	}
+	else if (pool->used < pool->capacity)
+	{
+		item = pool->items + pool->item_size * pool->used++;
+	}
+	else
+	{
+		return NULL;
+	}
+	__memoryUsage[pool->category] += pool->item_size;
+	return item;
+}
+
+static void pool_free(struct StaticPool *pool, void *item)
+{
+	if (item == NULL)
+	{
+		return;
+	}
+	memcpy(item, &pool->free_items, sizeof(void *));
+	pool->free_items = item;
+	__memoryUsage[pool->category] -= pool->item_size;
+}
+
+#define new_object(pool, category, type) pool_alloc(&pool)
+#define delete_object(pool, ptr) pool_free(&pool, ptr)
+#else
+#define new_object(pool, category, type) blz_malloc(category, sizeof(type))
+#define delete_object(pool, ptr) blz_free(ptr)
+
+/* Every allocation is prefixed with a header which keeps its size and
+ * category, so the usage counters can be updated on free */
+union AllocHeader
+{
+	struct
+	{
+		size_t size;
+		enum BLZ_MemoryCategory category;
+	} info;
+	long double align;
+};
+
+static void *default_alloc(size_t size, void *user_data)
+{
+	return malloc(size);
+}
+
+static void *default_realloc(void *ptr, size_t size, void *user_data)
+{
+	return realloc(ptr, size);
+}
+
+static void default_free(void *ptr, void *user_data)
+{
+	free(ptr);
+}
+
+static BLZ_AllocFunc __alloc = default_alloc;
+static BLZ_ReallocFunc __realloc = default_realloc;
+static BLZ_FreeFunc __free = default_free;
+static void *__allocUserData = NULL;
+
+static void *blz_malloc(enum BLZ_MemoryCategory category, size_t size)
+{
+	union AllocHeader *header = __alloc(sizeof(union AllocHeader) + size,
+										__allocUserData);
+	if (header == NULL)
+	{
+		return NULL;
+	}
+	header->info.size = size;
+	header->info.category = category;
+	__memoryUsage[category] += size;
+	return header + 1;
+}
+
+static void *blz_calloc(enum BLZ_MemoryCategory category,
+						size_t count, size_t size)
+{
+	void *result;
+	if (size != 0 && count > (size_t)-1 / size)
+	{
+		return NULL;
+	}
+	result = blz_malloc(category, count * size);
+	if (result != NULL)
+	{
+		memset(result, 0, count * size);
+	}
+	return result;
+}
+
+static void blz_free(void *ptr)
+{
+	union AllocHeader *header;
+	if (ptr == NULL)
+	{
+		return;
+	}
+	header = (union AllocHeader *)ptr - 1;
+	__memoryUsage[header->info.category] -= header->info.size;
+	__free(header, __allocUserData);
+}
+
+static void *blz_realloc(void *ptr, size_t size)
+{
+	union AllocHeader *header;
+	size_t old_size;
+	if (ptr == NULL)
+	{
+		return blz_malloc(MEMORY_TEXTURES, size);
+	}
+	header = (union AllocHeader *)ptr - 1;
+	old_size = header->info.size;
+	header = __realloc(header, sizeof(union AllocHeader) + size,
+					   __allocUserData);
+	if (header == NULL)
+	{
+		return NULL;
+	}
+	__memoryUsage[header->info.category] += size - old_size;
+	header->info.size = size;
+	return header + 1;
+}
+#endif
+
+/* SOIL is compiled with its malloc, calloc, realloc and free replaced by
+ * these, so the image decoding buffers are accounted as texture memory */
+void *blz_soil_malloc(size_t size)
+{
+#ifdef BLZ_CONFIG_STATIC
+	return malloc(size);
+#else
+	return blz_malloc(MEMORY_TEXTURES, size);
+#endif
+}
+
+void *blz_soil_calloc(size_t count, size_t size)
+{
+#ifdef BLZ_CONFIG_STATIC
+	return calloc(count, size);
+#else
+	return blz_calloc(MEMORY_TEXTURES, count, size);
+#endif
+}
+
+void *blz_soil_realloc(void *ptr, size_t size)
+{
+#ifdef BLZ_CONFIG_STATIC
+	return realloc(ptr, size);
+#else
+	return blz_realloc(ptr, size);
+#endif
+}
+
+void blz_soil_free(void *ptr)
+{
+#ifdef BLZ_CONFIG_STATIC
+	free(ptr);
+#else
+	blz_free(ptr);
+#endif
+}
+
 /* Public constants */
 const struct BLZ_BlendFunc BLEND_NORMAL = {GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA};
 const struct BLZ_BlendFunc BLEND_ADDITIVE = {GL_ONE, GL_ONE};
 const struct BLZ_BlendFunc BLEND_MULTIPLY = {GL_DST_COLOR, GL_ZERO};
+const struct BLZ_BlendFunc BLEND_PREMULTIPLIED = {GL_ONE, GL_ONE_MINUS_SRC_ALPHA};
 
 /* Internal values */
 struct Buffer
 {
 	GLuint vao, vbo, ebo;
+	/* custom vertex channels, 0 if the batch has none */
+	GLuint cbo;
+};
+
+/* custom vertex channels use the attribute locations after the color */
+#define CHANNEL_LIMIT 4
+#define FIRST_CHANNEL_LOCATION 3
+/* per-sprite depth of the opaque batches follows the channel values */
+#define DEPTH_LOCATION (FIRST_CHANNEL_LOCATION + CHANNEL_LIMIT)
+#define CHANNEL_SIZE(format) \
+	((format) == CHANNEL_FLOAT ? 4 * sizeof(GLfloat) : 4 * sizeof(GLubyte))
+
+
+/* Maximum count of sprites which are drawn by one coalesced immediate draw
+ * call, limited by 16-bit indices */
+#ifndef BLZ_IMMEDIATE_RING_SIZE
+#define BLZ_IMMEDIATE_RING_SIZE 1024
+#endif
+CASSERT(BLZ_IMMEDIATE_RING_SIZE > 0 && BLZ_IMMEDIATE_RING_SIZE <= 16384, blaze)
+
+/* Vertex data of dynamic batches is stored in fixed-size pages which are
+ * shared by all batches, so the memory usage follows the count of sprites
+ * in flight instead of the sum of configured limits. */
+#ifndef BLZ_VERTEX_PAGE_SIZE
+#define BLZ_VERTEX_PAGE_SIZE 65536
+#endif
+#define SPRITES_PER_PAGE (BLZ_VERTEX_PAGE_SIZE / sizeof(struct BLZ_SpriteQuad))
+
+union VertexPage
+{
+	union VertexPage *next;
+	struct BLZ_SpriteQuad quads[SPRITES_PER_PAGE];
+};
+
+#ifdef BLZ_CONFIG_STATIC
+#define PAGES_PER_BUCKET \
+	((BLZ_MAX_SPRITES_PER_BUCKET + SPRITES_PER_PAGE - 1) / SPRITES_PER_PAGE)
+/* enough pages to fill all of the buckets by default */
+#ifndef BLZ_MAX_VERTEX_PAGES
+#define BLZ_MAX_VERTEX_PAGES (BLZ_MAX_BATCHES * BLZ_MAX_BUCKETS * PAGES_PER_BUCKET)
+#endif
+#endif
+
+/* the compile-time maxima only size the static storage of a batch */
+#define BATCH_MAX_BUCKETS(batch) ((batch)->max_buckets)
+#define BATCH_MAX_SPRITES(batch) ((batch)->max_sprites_per_bucket)
+
+/* Shader, blend function and additional textures of a draw */
+struct DrawState
+{
+	/* NULL if the current shader and blend function should be used */
+	struct BLZ_Shader *shader;
+	struct BLZ_BlendFunc blend;
+	/* textures of slots starting from 1, 0 if the slot isn't changed */
+	GLuint textures[BLZ_MATERIAL_TEXTURES];
+};
+
+/* Buckets are materialized (get their vertex storage and GPU buffers) when
+ * they are used for the first time and can be released by BLZ_TrimBatch. */
+struct SpriteBucket
+{
+	GLuint texture;
+	/* material of the sprites, buckets are keyed by texture and material */
+	struct DrawState material;
+	int sprite_count;
+	/* batch frame number when the bucket was drawn last time */
+	unsigned int last_used;
+	/* set if the bucket's draw buffer wasn't filled yet */
+	unsigned char is_fresh;
+	unsigned char is_materialized;
+	/* vertex pages borrowed from the shared pool, returned on flush */
+#ifdef BLZ_CONFIG_STATIC
+	union VertexPage *pages[PAGES_PER_BUCKET];
+#else
+	union VertexPage **pages;
+#endif
+	/* custom vertex channel values, 4 vertices per sprite */
+#ifdef BLZ_CONFIG_STATIC
+#if BLZ_MAX_CHANNELS > 0
+	GLubyte channels[BLZ_MAX_SPRITES_PER_BUCKET * 4 * BLZ_MAX_CHANNELS *
+					 4 * sizeof(GLfloat)];
+#endif
+#else
+	GLubyte *channels;
+#endif
+	struct Buffer buffer[BUFFER_COUNT];
+};
+
+#if defined(BLZ_CONFIG_STATIC) && BLZ_MAX_CHANNELS == 0
+#define BUCKET_CHANNELS(bucket) ((GLubyte *)NULL)
+#else
+#define BUCKET_CHANNELS(bucket) ((GLubyte *)(bucket)->channels)
+#endif
+
+/* sprites of a static batch which are close to each other, they are
+ * stored sequentially and culled as a whole */
+struct StaticCell
+{
+	GLfloat min_x, min_y, max_x, max_y;
+	GLuint texture;
+	int first;
+	int count;
+};
+
+/* sprites changed after upload, uploaded on the next present */
+#define MAX_DIRTY_RANGES 8
+struct DirtyRange
+{
+	int first;
+	int end;
+};
+
+/* vertex layout of the static batches with QUANTIZED flag, the attributes
+ * are converted to floats by the vertex fetch */
+struct QuantizedVertex
+{
+	GLshort x, y;
+	GLushort u, v;
+	GLubyte r, g, b, a;
+};
+
+/* texture and grid cell of the sprite, used to sort the sprites */
+struct CellKey
+{
+	GLuint texture;
+	/* index of the first sprite with the same texture */
+	int order;
+	int x, y;
+	int index;
 };
 
 struct BLZ_StaticBatch
@@ -78,7 +401,36 @@ struct BLZ_StaticBatch
 	int sprite_count;
 	int max_sprite_count;
 	unsigned char is_uploaded;
+	enum BLZ_StaticFlags flags;
+	GLenum index_type;
+	/* 0 if the sprites are not split into cells */
+	GLfloat cell_size;
+	/* the sprites use different textures and are grouped by them */
+	GLboolean mixed_textures;
+	int cell_count;
+	int cell_capacity;
+	int dirty_count;
+	struct DirtyRange dirty[MAX_DIRTY_RANGES];
+#ifdef BLZ_CONFIG_STATIC
+	struct BLZ_Vertex vertices[BLZ_MAX_STATIC_SPRITES * 4];
+	GLuint textures[BLZ_MAX_STATIC_SPRITES];
+	/* places of the sprites in the sorted order, by the order of adding */
+	int slots[BLZ_MAX_STATIC_SPRITES];
+	struct StaticCell cells[BLZ_MAX_STATIC_CELLS];
+	/* index ranges of the visible cells and their textures */
+	const GLvoid *offsets[BLZ_MAX_STATIC_CELLS];
+	GLsizei counts[BLZ_MAX_STATIC_CELLS];
+	GLuint range_textures[BLZ_MAX_STATIC_CELLS];
+#else
+	/* NULL after upload with DISCARD_CPU_COPY flag */
 	struct BLZ_Vertex *vertices;
+	GLuint *textures;
+	int *slots;
+	struct StaticCell *cells;
+	const GLvoid **offsets;
+	GLsizei *counts;
+	GLuint *range_textures;
+#endif
 	struct Buffer buffer;
 	const struct BLZ_Texture *texture;
 };
@@ -90,34 +442,120 @@ struct BLZ_SpriteBatch
 	unsigned char buffer_index;
 	unsigned char frameskip;
 	enum BLZ_InitFlags flags;
+	unsigned int frame;
+	int channel_count;
+	enum BLZ_ChannelFormat channel_format;
+	/* size of the channel values and the depth of one vertex in bytes */
+	int channel_stride;
+	/* count of the sprites drawn by an opaque batch since the last flush */
+	int depth_sequence;
+#ifdef BLZ_CONFIG_STATIC
+	struct SpriteBucket sprite_buckets[BLZ_MAX_BUCKETS];
+#else
 	struct SpriteBucket *sprite_buckets;
+#endif
+};
+
+/* uniform names which don't fit are looked up by the driver */
+#define UNIFORM_NAME_SIZE 32
+
+/* Active uniform of a shader program along with the shadow copy of the value
+ * which was last set by the glUniform shims */
+struct Uniform
+{
+	char name[UNIFORM_NAME_SIZE];
+	GLint location;
+	/* size of the shadowed value in bytes, 0 if it's unknown */
+	GLsizei value_size;
+	GLfloat value[16];
 };
 
 struct BLZ_Shader
 {
 	GLuint program;
 	GLint mvp_param;
+	int uniform_count;
+#ifdef BLZ_CONFIG_STATIC
+	struct Uniform uniforms[BLZ_MAX_UNIFORMS];
+#else
+	struct Uniform *uniforms;
+#endif
+	/* uniformEpoch value for which the shadow copies are valid */
+	unsigned int epoch;
+	/* orthoGeneration of the last MVP matrix, 0 if it's a custom one */
+	unsigned int mvp_generation;
+	GLboolean is_mvp_known;
+	GLfloat mvp[16];
+	/* uniformBlocksGeneration for which the uniform blocks are bound */
+	unsigned int blocks_generation;
+	enum BLZ_ShaderStatus status;
+	/* compiled shader objects of the pending program */
+	GLuint vertex_shader;
+	GLuint fragment_shader;
+	/* hash of the sources and defines, the key of the program caches */
+	unsigned int hash;
+	/* independent hash of the same, see check_program */
+	unsigned int check;
+	GLboolean needs_saving;
+	/* variants are shared, the shader is freed with the last reference */
+	int references;
+	GLboolean is_variant;
+	struct BLZ_Shader *next_variant;
+	/* copy of the variant defines, each one is terminated by zero, they are
+	 * compared when the hashes of two variants match */
+#ifdef BLZ_CONFIG_STATIC
+	char defines[BLZ_VARIANT_DEFINES_SIZE];
+#else
+	char *defines;
+#endif
+	int define_count;
 };
 
-struct SpriteBucket
+#ifdef BLZ_CONFIG_STATIC
+STATIC_POOL(batchPool, struct BLZ_SpriteBatch, BLZ_MAX_BATCHES, MEMORY_BATCHES)
+STATIC_POOL(staticBatchPool, struct BLZ_StaticBatch, BLZ_MAX_STATIC_BATCHES,
+			MEMORY_BATCHES)
+STATIC_POOL(pagePool, union VertexPage, BLZ_MAX_VERTEX_PAGES, MEMORY_VERTICES)
+STATIC_POOL(shaderPool, struct BLZ_Shader, BLZ_MAX_SHADERS, MEMORY_SHADERS)
+STATIC_POOL(texturePool, struct BLZ_Texture, BLZ_MAX_TEXTURES, MEMORY_TEXTURES)
+STATIC_POOL(renderTargetPool, struct BLZ_RenderTarget, BLZ_MAX_RENDER_TARGETS,
+			MEMORY_RENDER_TARGETS)
+
+/* index data, static cell keys, shader logs and program binaries are the
+ * only temporary buffers and they are never used at the same time */
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define SCRATCH_SPRITES                                                \
+	MAX(MAX(BLZ_MAX_SPRITES_PER_BUCKET, BLZ_MAX_STATIC_SPRITES), \
+		MAX(BLZ_IMMEDIATE_RING_SIZE, BLZ_MAX_QUEUE_SPRITES))
+static union
 {
-	GLuint texture;
-	int sprite_count;
-	struct BLZ_Vertex *vertices;
-	struct Buffer buffer[BUFFER_COUNT];
-};
+	GLushort indices[SCRATCH_SPRITES * 6];
+	/* static batches above 16384 sprites use 32-bit indices */
+	GLuint static_indices[BLZ_MAX_STATIC_SPRITES * 6];
+	struct CellKey cell_keys[BLZ_MAX_STATIC_SPRITES];
+	char log[BLZ_SHADER_LOG_SIZE];
+	unsigned char binary[BLZ_PROGRAM_BINARY_SIZE];
+} __scratch;
+#endif
 
 static char *__lastError = NULL;
 
-#define Z_NEAR 0.9f
-#define Z_FAR 2.1f
-#define LAYER_DEPTH(depth) 1.0f + depth
+/* NDC depth of the opaque sprite with the specified 1-based sequence
+ * number, the later sprites are closer. Every opaque present maps it into
+ * its own slice of the depth range, see begin_opaque */
+#define SPRITE_DEPTH(sequence, capacity) \
+	(1.0f - 2.0f * (GLfloat)(sequence) / (GLfloat)((capacity) + 1))
 
 static GLfloat orthoMatrix[16] =
 	{0, 0, 0, 0,
 	 0, 0, 0, 0,
 	 0, 0, 1, 0,
 	 -1, 1, 0, 1};
+/* incremented when orthoMatrix changes, so the shaders which already have
+ * the current matrix are not updated again */
+static unsigned int orthoGeneration = 1;
+/* incremented by BLZ_InvalidateGLState to drop the uniform shadow copies */
+static unsigned int uniformEpoch = 0;
 
 static GLchar vertexSource[] =
 	"#version 130\n"
@@ -125,12 +563,13 @@ static GLchar vertexSource[] =
 	"in vec2 in_Position;"
 	"in vec2 in_Texcoord;"
 	"in vec4 in_Color;"
+	"in float in_Depth;"
 	"out vec4 ex_Color;"
 	"out vec2 ex_Texcoord;"
 	"void main() {"
 	"  ex_Color = in_Color;"
 	"  ex_Texcoord = in_Texcoord;"
-	"  gl_Position = u_mvpMatrix * vec4(in_Position, 1, 1);"
+	"  gl_Position = u_mvpMatrix * vec4(in_Position, in_Depth, 1);"
 	"}";
 
 static GLchar fragmentSource[] =
@@ -141,689 +580,4308 @@ static GLchar fragmentSource[] =
 	"uniform sampler2D tex;"
 	"void main() {"
 	"  outColor = texture(tex, ex_Texcoord) * ex_Color;"
+	"\n#ifdef BLZ_ALPHA_TEST\n"
+	"  if (outColor.a < BLZ_ALPHA_TEST) discard;"
+	"\n#endif\n"
+	"#ifdef BLZ_GRAYSCALE\n"
+	"  outColor.rgb = vec3(dot(outColor.rgb, vec3(0.299, 0.587, 0.114)));"
+	"\n#endif\n"
 	"}";
 
+/* maximum count of defines per shader variant */
+#define MAX_SHADER_DEFINES 16
+
 static BLZ_Shader *SHADER_DEFAULT;
 static BLZ_Shader *SHADER_CURRENT;
+/* alpha-tested variant of the default shader for the opaque batches */
+static BLZ_Shader *SHADER_OPAQUE;
+static const char *const opaqueDefines[] = {"BLZ_ALPHA_TEST 0.5", NULL};
+/* shaders created by BLZ_CompileShaderVariant, linked by next_variant */
+static BLZ_Shader *variantShaders = NULL;
 static struct Buffer immediateBuf;
 static GLuint tex0_override = 0;
 
-static const int VERT_SIZE = sizeof(struct BLZ_Vertex);
+/* Coalesced immediate drawing, see BLZ_SetImmediateMode */
+static enum BLZ_ImmediateMode immediateMode = IMMEDIATE_DIRECT;
+static struct Buffer immediateRing;
+#ifdef BLZ_CONFIG_STATIC
+static struct BLZ_SpriteQuad immediateQuads[BLZ_IMMEDIATE_RING_SIZE];
+#else
+static struct BLZ_SpriteQuad *immediateQuads = NULL;
+#endif
+static int immediateCount = 0;
+static GLuint immediateTexture = 0;
+/* position of the next free sprite slot in the ring vertex buffer */
+static int immediateRingOffset = 0;
+static void flush_immediate();
 
-/* TODO: Optimization: Reuse same VAO for all batches to minimize state changes */
-static struct Buffer create_buffer(int max_sprites, GLenum usage)
+/* State which is recorded by the render queue commands */
+static struct BLZ_BlendFunc currentBlend = {GL_ONE, GL_ZERO};
+static int premultipliedAlpha = 0;
+static struct BLZ_Vector4 currentClearColor = {0, 0, 0, 0};
+static GLuint currentTarget = 0;
+/* depth range slice of the next opaque present to the screen or to the
+ * bound render target, restarts with BLZ_Clear */
+static int screenDepthSlice = 0;
+static int *currentDepthSlice = &screenDepthSlice;
+static int currentLayer = 0;
+static struct BLZ_RenderQueue *__activeQueue = NULL;
+static int queue_clear();
+
+/* GL state cache */
+/* Shadow copy of the OpenGL state which is changed by the library, the calls
+ * which don't change anything are skipped. UNKNOWN means that the state
+ * should be set anyway, see BLZ_InvalidateGLState. */
+#define UNKNOWN ((GLuint)-1)
+#define CACHED_TEXTURE_UNITS 32
+static struct
+{
+	GLuint active_unit;
+	GLuint textures[CACHED_TEXTURE_UNITS];
+	GLuint vao;
+	GLuint array_buffer;
+	GLuint program;
+	GLenum blend_source, blend_destination;
+	GLuint framebuffer;
+} glState;
+
+static void invalidate_state()
 {
-	int INDICES_SIZE = max_sprites * 6 * sizeof(GLushort);
 	int i;
-	struct Buffer result;
-	GLushort *indices = malloc(INDICES_SIZE);
-	GLuint vao, vbo, ebo;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, VERT_SIZE * 4 * max_sprites,
-				 NULL, usage);
-	/* x|y */
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)0);
-	/* u|v */
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)8);
-	/* r|g|b|a */
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)16);
-	/* indices */
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	for (i = 0; i < max_sprites; i++)
+	glState.active_unit = UNKNOWN;
+	for (i = 0; i < CACHED_TEXTURE_UNITS; i++)
 	{
-		*(indices + (i * 6)) = (GLushort)(i * 4);
-		*(indices + (i * 6) + 1) = (GLushort)(i * 4 + 1);
-		*(indices + (i * 6) + 2) = (GLushort)(i * 4 + 2);
-		*(indices + (i * 6) + 3) = (GLushort)(i * 4 + 2);
-		*(indices + (i * 6) + 4) = (GLushort)(i * 4 + 1);
-		*(indices + (i * 6) + 5) = (GLushort)(i * 4 + 3);
+		glState.textures[i] = UNKNOWN;
 	}
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, INDICES_SIZE, indices, GL_STATIC_DRAW);
-	free(indices);
-	glBindVertexArray(0);
-	result.vao = vao;
-	result.vbo = vbo;
-	return result;
+	glState.vao = UNKNOWN;
+	glState.array_buffer = UNKNOWN;
+	glState.program = UNKNOWN;
+	glState.blend_source = glState.blend_destination = UNKNOWN;
+	glState.framebuffer = UNKNOWN;
 }
 
-static void free_buffer(struct Buffer buffer)
+static void state_bind_texture(GLuint unit, GLuint texture)
 {
-	glDeleteVertexArrays(1, &buffer.vao);
-	glDeleteBuffers(1, &buffer.vbo);
+	if (unit >= CACHED_TEXTURE_UNITS)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glState.active_unit = UNKNOWN;
+		return;
+	}
+	if (glState.textures[unit] == texture)
+	{
+		return;
+	}
+	if (glState.active_unit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glState.active_unit = unit;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glState.textures[unit] = texture;
 }
 
-/* Public API */
-char* BLZ_GetLastError()
+/* binds the texture to the active unit so its parameters can be changed,
+ * returns the texture it replaced for state_restore_texture_any */
+static GLuint state_bind_texture_any(GLuint texture)
 {
-	return __lastError;
+	GLuint previous;
+	if (glState.active_unit >= CACHED_TEXTURE_UNITS)
+	{
+		state_bind_texture(0, texture);
+		return UNKNOWN;
+	}
+	previous = glState.textures[glState.active_unit];
+	state_bind_texture(glState.active_unit, texture);
+	return previous;
 }
 
-int BLZ_Load(glGetProcAddress loader)
+/* puts the replaced texture back, so the textures bound by the user or by
+ * the materials stay on their units */
+static void state_restore_texture_any(GLuint previous)
 {
-	int result = gladLoadGLLoader((GLADloadproc)loader);
-	fail_if_false(result, "Could not load the OpenGL library");
-	SHADER_DEFAULT = BLZ_CompileShader(vertexSource, fragmentSource);
-	fail_if_false(SHADER_DEFAULT, "Could not compile default shader");
-	fail_if_false(BLZ_UseShader(SHADER_DEFAULT), "Could not use default shader");
-	immediateBuf = create_buffer(1, GL_STREAM_DRAW);
-	glDisable(GL_DEPTH_TEST);
-	glDepthMask(GL_FALSE);
-	glEnable(GL_BLEND);
-	success();
+	if (previous != UNKNOWN)
+	{
+		state_bind_texture(glState.active_unit, previous);
+	}
 }
 
-int BLZ_GetMaxTextureSlots()
+/* SOIL binds the textures it creates to the active unit */
+static void state_forget_active_texture()
 {
-	GLint result;
-	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &result);
-	return result;
+	if (glState.active_unit < CACHED_TEXTURE_UNITS)
+	{
+		glState.textures[glState.active_unit] = UNKNOWN;
+	}
+	else
+	{
+		invalidate_state();
+	}
 }
 
-int BLZ_BindTexture(struct BLZ_Texture *texture, int slot)
+/* deleted object names can be reused by OpenGL */
+static void state_forget_texture(GLuint texture)
 {
-	GLuint id = texture == NULL ? 0 : texture->id;
-	glActiveTexture(GL_TEXTURE0 + slot);
-	glBindTexture(GL_TEXTURE_2D, id);
-	if (slot == 0)
+	int i;
+	for (i = 0; i < CACHED_TEXTURE_UNITS; i++)
 	{
-		tex0_override = id;
+		if (glState.textures[i] == texture)
+		{
+			glState.textures[i] = UNKNOWN;
+		}
 	}
-	success();
 }
 
-int BLZ_SetTextureFiltering(
-	struct BLZ_Texture *texture,
-	enum BLZ_TextureFilter minification,
-	enum BLZ_TextureFilter magnification)
+static void state_bind_vao(GLuint vao)
 {
-	glBindTexture(GL_TEXTURE_2D, texture->id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minification);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magnification);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	success();
+	if (glState.vao != vao)
+	{
+		glBindVertexArray(vao);
+		glState.vao = vao;
+	}
 }
 
-int BLZ_SetTextureWrap(
-	struct BLZ_Texture *texture,
-	enum BLZ_TextureWrap x,
-	enum BLZ_TextureWrap y)
+static void state_bind_array_buffer(GLuint buffer)
 {
-	glBindTexture(GL_TEXTURE_2D, texture->id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, x);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, y);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	success();
+	if (glState.array_buffer != buffer)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glState.array_buffer = buffer;
+	}
 }
 
-static void bind_tex0(GLuint tex)
+static void state_use_program(GLuint program)
 {
-	if (tex0_override == 0)
+	if (glState.program != program)
 	{
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, tex);
+		glUseProgram(program);
+		glState.program = program;
 	}
 }
 
-int BLZ_GetOptions(const struct BLZ_SpriteBatch *batch,
-				   int *max_buckets, int *max_sprites_per_bucket,
-				   enum BLZ_InitFlags *flags)
+static void state_blend_func(GLenum source, GLenum destination)
 {
-	validate(batch != NULL);
-	if (batch->max_buckets <= 0 || batch->max_sprites_per_bucket <= 0)
+	if (glState.blend_source != source ||
+		glState.blend_destination != destination)
 	{
-		fail("Not initialized");
+		glBlendFunc(source, destination);
+		glState.blend_source = source;
+		glState.blend_destination = destination;
 	}
-	*max_buckets = batch->max_buckets;
-	*max_sprites_per_bucket = batch->max_sprites_per_bucket;
-	*flags = batch->flags;
-	success();
 }
 
-int BLZ_SetViewport(int w, int h)
+static void state_bind_framebuffer(GLuint framebuffer)
 {
-	validate(w > 0);
-	validate(h > 0);
-	orthoMatrix[0] = 2.0f / (GLfloat)w;
-	orthoMatrix[5] = -2.0f / (GLfloat)h;
-	success();
+	if (glState.framebuffer != framebuffer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glState.framebuffer = framebuffer;
+	}
 }
 
-void BLZ_SetClearColor(struct BLZ_Vector4 color)
-{
-	glClearColor(color.x, color.y, color.z, color.w);
-}
+static const int VERT_SIZE = sizeof(struct BLZ_Vertex);
 
-void BLZ_SetBlendMode(const struct BLZ_BlendFunc func)
-{
-	glBlendFunc(func.source, func.destination);
-}
+/* 16-bit indices address up to 65536 vertices */
+#define MAX_SHORT_INDEXED_SPRITES 16384
+#define INDEX_SIZE(type) \
+	((type) == GL_UNSIGNED_INT ? sizeof(GLuint) : sizeof(GLushort))
 
-void BLZ_Clear()
+/* the reversed indices list the quads from the last one, so the last N
+ * quads are drawn first by the range which starts at (max_sprites - N) */
+static void fill_indices(void *indices, GLenum index_type, int max_sprites,
+						 int reversed)
 {
-	glClear(GL_COLOR_BUFFER_BIT);
+	static const int QUAD_INDICES[6] = {0, 1, 2, 2, 1, 3};
+	int i, j, quad;
+	for (i = 0; i < max_sprites; i++)
+	{
+		quad = reversed ? max_sprites - 1 - i : i;
+		for (j = 0; j < 6; j++)
+		{
+			if (index_type == GL_UNSIGNED_INT)
+			{
+				((GLuint *)indices)[i * 6 + j] = (GLuint)(quad * 4 + QUAD_INDICES[j]);
+			}
+			else
+			{
+				((GLushort *)indices)[i * 6 + j] = (GLushort)(quad * 4 + QUAD_INDICES[j]);
+			}
+		}
+	}
 }
 
-static GLuint compile_shader(GLenum type, const char *src)
+/* TODO: Optimization: Reuse same VAO for all batches to minimize state changes */
+static struct Buffer create_buffer_indexed(int max_sprites, GLenum usage,
+										   GLenum index_type, int reversed)
 {
-	int compiled;
-	int log_length;
-	char *log_string;
-	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, (const GLchar **)&src, 0);
-	glCompileShader(shader);
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled)
-	{
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
-		log_string = malloc(log_length);
-		glGetShaderInfoLog(shader, log_length, &log_length, log_string);
-		printf("Error compiling shader: %s\n", log_string);
-		free(log_string);
-		return 0;
-	}
-	return shader;
+	int INDICES_SIZE = max_sprites * 6 * INDEX_SIZE(index_type);
+	struct Buffer result;
+#ifdef BLZ_CONFIG_STATIC
+	/* holds either kind of indices for every pool */
+	void *indices = __scratch.indices;
+#else
+	void *indices = blz_malloc(MEMORY_TEMPORARY, INDICES_SIZE);
+#endif
+	GLuint vao, vbo, ebo;
+	glGenVertexArrays(1, &vao);
+	state_bind_vao(vao);
+	glGenBuffers(1, &vbo);
+	state_bind_array_buffer(vbo);
+	glBufferData(GL_ARRAY_BUFFER, VERT_SIZE * 4 * max_sprites,
+				 NULL, usage);
+	/* x|y */
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)0);
+	/* u|v */
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)8);
+	/* r|g|b|a */
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, VERT_SIZE, (void *)16);
+	/* indices */
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	fill_indices(indices, index_type, max_sprites, reversed);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, INDICES_SIZE, indices, GL_STATIC_DRAW);
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(indices);
+#endif
+	state_bind_vao(0);
+	result.vao = vao;
+	result.vbo = vbo;
+	result.ebo = ebo;
+	result.cbo = 0;
+	return result;
 }
 
-GLint BLZ_GetUniformLocation(const struct BLZ_Shader *shader, const char *name)
+static struct Buffer create_buffer(int max_sprites, GLenum usage)
 {
-	if (shader == NULL || name == NULL)
+	return create_buffer_indexed(max_sprites, usage, GL_UNSIGNED_SHORT,
+								 BLZ_FALSE);
+}
+
+/* adds a separate vertex buffer for the custom channels and the depth of
+ * the opaque sprites to the VAO */
+static void add_channel_buffer(
+	struct Buffer *buffer,
+	int max_sprites,
+	int channel_count,
+	enum BLZ_ChannelFormat format,
+	GLsizei stride)
+{
+	int i;
+	state_bind_vao(buffer->vao);
+	glGenBuffers(1, &buffer->cbo);
+	state_bind_array_buffer(buffer->cbo);
+	glBufferData(GL_ARRAY_BUFFER, stride * 4 * max_sprites, NULL, GL_STREAM_DRAW);
+	for (i = 0; i < channel_count; i++)
 	{
-		return -1;
+		glEnableVertexAttribArray(FIRST_CHANNEL_LOCATION + i);
+		glVertexAttribPointer(FIRST_CHANNEL_LOCATION + i, 4,
+							  format == CHANNEL_FLOAT ? GL_FLOAT : GL_UNSIGNED_BYTE,
+							  format == CHANNEL_FLOAT ? GL_FALSE : GL_TRUE,
+							  stride, (void *)(i * CHANNEL_SIZE(format)));
 	}
-	return glGetUniformLocation(shader->program, (const GLchar *)name);
+	if (stride > channel_count * CHANNEL_SIZE(format))
+	{
+		glEnableVertexAttribArray(DEPTH_LOCATION);
+		glVertexAttribPointer(DEPTH_LOCATION, 1, GL_FLOAT, GL_FALSE, stride,
+							  (void *)(channel_count * CHANNEL_SIZE(format)));
+	}
+	state_bind_vao(0);
 }
 
-BLZ_Shader *BLZ_CompileShader(const char *vert, const char *frag)
+static void free_buffer(struct Buffer buffer)
 {
-	struct BLZ_Shader *shader;
-	GLuint program, vertex_shader, fragment_shader;
-	int is_linked, log_length;
-	char *log_string;
-	validate(vert != NULL);
-	validate(frag != NULL);
-	shader = malloc(sizeof(struct BLZ_Shader));
-	vertex_shader = compile_shader(GL_VERTEX_SHADER, vert);
-	if (!vertex_shader)
+	if (glState.vao == buffer.vao)
 	{
-		return NULL;
+		glState.vao = UNKNOWN;
 	}
-	fragment_shader = compile_shader(GL_FRAGMENT_SHADER, frag);
-	if (!fragment_shader)
+	if (glState.array_buffer == buffer.vbo ||
+		(buffer.cbo != 0 && glState.array_buffer == buffer.cbo))
 	{
-		return NULL;
+		glState.array_buffer = UNKNOWN;
 	}
-	program = glCreateProgram();
-	glAttachShader(program, vertex_shader);
-	glAttachShader(program, fragment_shader);
-	glBindAttribLocation(program, 0, "in_Position");
-	glBindAttribLocation(program, 1, "in_Texcoord");
-	glBindAttribLocation(program, 2, "in_Color");
-	glLinkProgram(program);
-	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
-	if (!is_linked)
+	glDeleteVertexArrays(1, &buffer.vao);
+	glDeleteBuffers(1, &buffer.vbo);
+	glDeleteBuffers(1, &buffer.ebo);
+	if (buffer.cbo != 0)
 	{
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
-		log_string = malloc(log_length);
-		glGetProgramInfoLog(program, log_length, &log_length, log_string);
-		printf("Error linking shader: %s\n", log_string);
-		free(log_string);
-		return NULL;
+		glDeleteBuffers(1, &buffer.cbo);
 	}
-	shader->program = program;
-	shader->mvp_param = BLZ_GetUniformLocation(shader, "u_mvpMatrix");
-	return shader;
 }
 
-int BLZ_UseShader(struct BLZ_Shader *program)
+/* Vertex page pool */
+/* free pages are reused in LIFO order to keep them hot in cache */
+#ifdef BLZ_CONFIG_STATIC
+static union VertexPage *acquire_page()
 {
-	GLenum result;
-	validate(program != NULL);
-	/* clear previous errors to make sure we're reading the actual one */
-	while (glGetError() != GL_NO_ERROR)
-	{
-	};
-	glUseProgram(program->program);
-	result = glGetError();
-	if (result == GL_NO_ERROR)
+	return pool_alloc(&pagePool);
+}
+
+static void release_page(union VertexPage *page)
+{
+	pool_free(&pagePool, page);
+}
+#else
+static union VertexPage *__freePages = NULL;
+
+static union VertexPage *acquire_page()
+{
+	union VertexPage *page = __freePages;
+	if (page == NULL)
 	{
-		SHADER_CURRENT = program;
-		success();
+		return blz_malloc(MEMORY_VERTICES, sizeof(union VertexPage));
 	}
-	printf("glUseProgram: error %d\n", result);
-	fail("Could not use shader program");
+	__freePages = page->next;
+	return page;
 }
 
-int BLZ_FreeShader(BLZ_Shader *program)
+static void release_page(union VertexPage *page)
 {
-	validate(program != NULL);
-	glDeleteShader(program->program);
-	free(program);
-	success();
+	page->next = __freePages;
+	__freePages = page;
 }
+#endif
 
-BLZ_Shader *BLZ_GetDefaultShader()
+/* Uniform buffers */
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+#ifndef GL_INVALID_INDEX
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+#define FRAME_DATA_BLOCK "BLZ_FrameData"
+/* the user blocks use the binding points which follow this one */
+#define FRAME_DATA_BINDING 0
+
+/* std140 layout of the BLZ_FrameData block */
+CASSERT(sizeof(struct BLZ_FrameData) == 80, blaze)
+CASSERT(offsetof(struct BLZ_FrameData, resolution) == 64, blaze)
+CASSERT(offsetof(struct BLZ_FrameData, time) == 72, blaze)
+CASSERT(offsetof(struct BLZ_FrameData, delta_time) == 76, blaze)
+
+struct BLZ_UniformBuffer
 {
-	return SHADER_DEFAULT;
-}
+	GLuint id;
+	GLuint binding;
+	size_t size;
+	char block_name[UNIFORM_NAME_SIZE];
+};
 
-int BLZ_FreeBatch(struct BLZ_SpriteBatch *batch)
+#ifdef BLZ_CONFIG_STATIC
+STATIC_POOL(uniformBufferPool, struct BLZ_UniformBuffer,
+			BLZ_MAX_UNIFORM_BUFFERS, MEMORY_SHADERS)
+#endif
+
+/* OpenGL 3.1 functions which are not provided by the loader */
+typedef GLuint(APIENTRYP GetUniformBlockIndexFunc)(GLuint program,
+												   const GLchar *name);
+typedef void(APIENTRYP UniformBlockBindingFunc)(GLuint program,
+												GLuint index,
+												GLuint binding);
+static GetUniformBlockIndexFunc __getUniformBlockIndex = NULL;
+static UniformBlockBindingFunc __uniformBlockBinding = NULL;
+
+static struct BLZ_FrameData frameData;
+static GLuint frameDataBuffer = 0;
+/* slot index + 1 is the binding point of the buffer */
+static struct BLZ_UniformBuffer *uniformBuffers[BLZ_MAX_UNIFORM_BUFFERS];
+/* incremented when the shaders should connect their uniform blocks again */
+static unsigned int uniformBlocksGeneration = 1;
+
+static int has_extension(const char *name)
 {
-	int i;
-	struct SpriteBucket cur;
-	if (batch->sprite_buckets != NULL)
+	GLint i, count = 0;
+	const GLubyte *extension;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (i = 0; i < count; i++)
 	{
-		for (i = 0; i < batch->max_buckets; i++)
+		extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension != NULL && strcmp((const char *)extension, name) == 0)
 		{
-			cur = *(batch->sprite_buckets + i);
-			free_buffer(cur.buffer[0]);
-			if (!HAS_FLAG(batch, NO_BUFFERING))
-			{
-				free_buffer(cur.buffer[1]);
-				free_buffer(cur.buffer[2]);
-			}
+			return BLZ_TRUE;
 		}
-		free(batch->sprite_buckets);
 	}
-	free(batch);
-	success();
+	return BLZ_FALSE;
 }
 
-struct BLZ_SpriteBatch *BLZ_CreateBatch(
-	int max_buckets, int max_sprites_per_bucket, enum BLZ_InitFlags flags)
+/* ISO C doesn't allow casting the loader result to a function pointer */
+static void load_function(glGetProcAddress loader, const char *name,
+						  void *function)
 {
-	int i;
-	struct BLZ_Vertex *vertices;
-	struct SpriteBucket *cur;
-	struct BLZ_SpriteBatch *batch = malloc(sizeof(BLZ_SpriteBatch));
-	null_if_invalid(max_buckets > 0);
-	null_if_invalid(max_sprites_per_bucket > 0);
-	batch->max_sprites_per_bucket = max_sprites_per_bucket;
-	batch->max_buckets = max_buckets;
-	batch->flags = flags;
-	batch->buffer_index = 0;
-	if (!HAS_FLAG(batch, NO_BUFFERING))
+	void *address = loader(name);
+	memcpy(function, &address, sizeof(address));
+}
+
+static void load_uniform_buffers(glGetProcAddress loader)
+{
+	__getUniformBlockIndex = NULL;
+	__uniformBlockBinding = NULL;
+	frameDataBuffer = 0;
+	if (GLVersion.major < 3 || (GLVersion.major == 3 && GLVersion.minor < 1))
 	{
-		batch->frameskip = 1;
+		if (!has_extension("GL_ARB_uniform_buffer_object"))
+		{
+			return;
+		}
 	}
-	batch->sprite_buckets = calloc(batch->max_buckets, sizeof(struct SpriteBucket));
-	check_alloc(batch->sprite_buckets);
-	for (i = 0; i < batch->max_buckets; i++)
+	load_function(loader, "glGetUniformBlockIndex", &__getUniformBlockIndex);
+	load_function(loader, "glUniformBlockBinding", &__uniformBlockBinding);
+	if (__getUniformBlockIndex == NULL || __uniformBlockBinding == NULL)
 	{
-		cur = (batch->sprite_buckets + i);
-		vertices = malloc(batch->max_sprites_per_bucket * 4 * sizeof(struct BLZ_Vertex));
-		check_alloc(vertices);
-		cur->vertices = vertices;
-		cur->buffer[0] = create_buffer(max_sprites_per_bucket, GL_STREAM_DRAW);
-		cur->buffer[1] = create_buffer(max_sprites_per_bucket, GL_STREAM_DRAW);
+		__getUniformBlockIndex = NULL;
+		__uniformBlockBinding = NULL;
+		return;
 	}
-	return batch;
+	glGenBuffers(1, &frameDataBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frameData), &frameData,
+				 GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameDataBuffer);
 }
 
-static inline void set_mvp_matrix(const GLfloat *matrix)
+static void upload_frame_data()
 {
-	if (SHADER_CURRENT->mvp_param > -1)
+	if (frameDataBuffer == 0)
 	{
-		BLZ_UniformMatrix4fv(SHADER_CURRENT->mvp_param, 1, GL_FALSE, matrix);
+		return;
 	}
+	glBindBuffer(GL_UNIFORM_BUFFER, frameDataBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frameData), &frameData);
 }
 
-static struct BLZ_SpriteBatch *__lastBatch;
-static struct SpriteBucket *__lastBucket;
-static GLuint __lastTexture;
-static int flush(struct BLZ_SpriteBatch *batch)
+static void rebind_uniform_buffers()
 {
-	unsigned char to_draw, to_fill;
-	struct SpriteBucket bucket;
-	struct SpriteBucket *bucket_ptr;
-	int i, buf_size;
-	set_mvp_matrix((const GLfloat *)&orthoMatrix);
-	if (HAS_FLAG(batch, NO_BUFFERING) || batch->frameskip)
+	int i;
+	if (frameDataBuffer == 0)
 	{
-		to_draw = to_fill = 0;
+		return;
 	}
-	else
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameDataBuffer);
+	for (i = 0; i < BLZ_MAX_UNIFORM_BUFFERS; i++)
 	{
-		to_draw = batch->buffer_index,
-		to_fill = batch->buffer_index + 1;
-		if (to_fill >= BUFFER_COUNT)
+		if (uniformBuffers[i] != NULL)
 		{
-			to_fill -= BUFFER_COUNT;
+			glBindBufferBase(GL_UNIFORM_BUFFER, uniformBuffers[i]->binding,
+							 uniformBuffers[i]->id);
 		}
 	}
-	for (i = 0; i < batch->max_buckets; i++)
+	uniformBlocksGeneration++;
+}
+
+static void bind_uniform_block(GLuint program, const char *name, GLuint binding)
+{
+	GLuint index = __getUniformBlockIndex(program, (const GLchar *)name);
+	if (index != GL_INVALID_INDEX)
 	{
-		bucket_ptr = (batch->sprite_buckets + i);
-		bucket = *bucket_ptr;
-		buf_size = bucket.sprite_count * 4 * sizeof(struct BLZ_Vertex);
-		if (buf_size == 0 || bucket.texture == 0)
-		{
-			/* we've reached the end of the batch */
-			break;
-		}
-		/* fill the buffer */
-		glBindBuffer(GL_ARRAY_BUFFER, bucket.buffer[to_fill].vbo);
-		glBufferData(GL_ARRAY_BUFFER, buf_size, bucket.vertices, GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		/* bind our texture and the VAO and draw it */
-		bind_tex0(bucket.texture);
-		glBindVertexArray(bucket.buffer[to_draw].vao);
-		glDrawElements(GL_TRIANGLES, bucket.sprite_count * 6, GL_UNSIGNED_SHORT, (void *)0);
-		bucket_ptr->sprite_count = 0;
-		bucket_ptr->texture = 0;
+		__uniformBlockBinding(program, index, binding);
 	}
-	__lastBatch = NULL;
-	__lastBucket = NULL;
-	__lastTexture = 0;
-	success();
 }
 
-int BLZ_Present(struct BLZ_SpriteBatch *batch)
+/* connects the uniform blocks declared by the shader to their buffers */
+static void bind_uniform_blocks(struct BLZ_Shader *shader)
 {
-	fail_if_false(flush(batch), "Could not flush the sprite batch");
-	if (!HAS_FLAG(batch, NO_BUFFERING) && batch->frameskip == 0)
+	int i;
+	shader->blocks_generation = uniformBlocksGeneration;
+	if (frameDataBuffer == 0)
 	{
-		batch->buffer_index++;
-		if (batch->buffer_index >= BUFFER_COUNT)
-		{
-			batch->buffer_index -= BUFFER_COUNT;
-		}
+		return;
 	}
-	if (batch->frameskip > 0)
+	bind_uniform_block(shader->program, FRAME_DATA_BLOCK, FRAME_DATA_BINDING);
+	for (i = 0; i < BLZ_MAX_UNIFORM_BUFFERS; i++)
 	{
-		batch->frameskip--;
+		if (uniformBuffers[i] != NULL)
+		{
+			bind_uniform_block(shader->program, uniformBuffers[i]->block_name,
+							   uniformBuffers[i]->binding);
+		}
 	}
-	success();
 }
 
-#define set_vertex(index, field, val)     \
-	do                                    \
-	{                                     \
-		quad.vertices[index].field = val; \
-	} while (0);
+/* Program binary cache */
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#define CACHE_DIR_SIZE 256
+#define CACHE_PATH_SIZE (CACHE_DIR_SIZE + 32)
+#define CACHE_INDEX "blz_index.txt"
+#define CACHE_MAGIC 0x505A4C42u /* "BLZP" */
+#define CACHE_VERSION 2
+#define CACHE_LINE_SIZE 64
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
 
-#define set_all_vertices(field, val) \
-	do                               \
-	{                                \
-		set_vertex(0, field, val);   \
-		set_vertex(1, field, val);   \
-		set_vertex(2, field, val);   \
-		set_vertex(3, field, val);   \
-	} while (0);
+/* OpenGL 4.1 functions which are not provided by the loader */
+typedef void(APIENTRYP GetProgramBinaryFunc)(GLuint program, GLsizei size,
+											 GLsizei *length, GLenum *format,
+											 void *binary);
+typedef void(APIENTRYP ProgramBinaryFunc)(GLuint program, GLenum format,
+										  const void *binary, GLsizei length);
+typedef void(APIENTRYP ProgramParameteriFunc)(GLuint program, GLenum name,
+											  GLint value);
+static GetProgramBinaryFunc __getProgramBinary = NULL;
+static ProgramBinaryFunc __programBinary = NULL;
+static ProgramParameteriFunc __programParameteri = NULL;
 
-#define swap(tmp, one, two) \
-	do                      \
-	{                       \
-		tmp = one;          \
-		one = two;          \
-		two = tmp;          \
-	} while (0);
+/* written before the binary itself, the cache file is rejected if any of
+ * the fields don't match */
+struct ProgramFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int source_hash;
+	unsigned int source_check;
+	unsigned int driver_hash;
+	GLenum format;
+	GLint length;
+};
 
-static struct BLZ_SpriteQuad transform_position_fastpath(
-	const struct BLZ_Texture *texture,
-	const struct BLZ_Vector2 position,
-	const struct BLZ_Vector4 color)
+/* linked program which was preloaded from the cache */
+struct WarmProgram
 {
-	GLfloat x = position.x;
-	GLfloat y = position.y;
-	GLfloat w = (GLfloat)texture->width;
-	GLfloat h = (GLfloat)texture->height;
-	struct BLZ_SpriteQuad quad;
+	unsigned int hash;
+	unsigned int check;
+	GLuint program;
+};
 
-	/* set the vertex values */
-	set_vertex(0, x, x);
-	set_vertex(0, y, y);
-	set_vertex(0, u, 0);
-	set_vertex(0, v, 0);
-	set_vertex(2, x, x + w);
-	set_vertex(2, y, y);
-	set_vertex(2, u, 1);
-	set_vertex(2, v, 0);
-	set_vertex(3, x, x + w);
-	set_vertex(3, y, y + h);
-	set_vertex(3, u, 1);
-	set_vertex(3, v, 1);
-	set_vertex(1, x, x);
-	set_vertex(1, y, y + h);
-	set_vertex(1, u, 0);
-	set_vertex(1, v, 1);
-
-	set_all_vertices(r, color.x);
-	set_all_vertices(g, color.y);
-	set_all_vertices(b, color.z);
-	set_all_vertices(a, color.w);
-	return quad;
-}
+static char shaderCacheDir[CACHE_DIR_SIZE] = "";
+/* hash of the vendor, renderer and version strings */
+static unsigned int driverHash = 0;
+static struct WarmProgram warmPrograms[BLZ_MAX_CACHED_PROGRAMS];
+static int warmProgramCount = 0;
 
-static struct BLZ_SpriteQuad transform_full(
-	const struct BLZ_Texture *texture,
-	const struct BLZ_Vector2 position,
-	const struct BLZ_Rectangle *srcRectangle,
-	float rotation,
-	const struct BLZ_Vector2 *origin,
-	const struct BLZ_Vector2 *scale,
-	const struct BLZ_Vector4 color,
-	enum BLZ_SpriteFlip effects)
+static unsigned int hash_string(unsigned int hash, const char *str)
 {
-	/* position: top-left, top-right, bottom-left, bottom-right */
-	struct BLZ_Vector2 p_tl, p_tr, p_bl, p_br;
-	/* same for texture coordinates */
-	struct BLZ_Vector2 t_tl, t_tr, t_bl, t_br;
-	struct BLZ_SpriteQuad quad;
-	GLfloat dx, dy;
-	GLfloat x = position.x;
-	GLfloat y = position.y;
-	GLfloat tw = (GLfloat)texture->width;
-	GLfloat th = (GLfloat)texture->height;
-	int w = srcRectangle == NULL ? tw : srcRectangle->w;
-	int h = srcRectangle == NULL ? th : srcRectangle->h;
-	GLfloat _sin = rotation == 0.0f ? 0.0f : sin(rotation);
-	GLfloat _cos = rotation == 0.0f ? 1.0f : cos(rotation);
-	GLfloat u1 = srcRectangle == NULL ? 0 : srcRectangle->x / tw;
-	GLfloat v1 = srcRectangle == NULL ? 0 : srcRectangle->y / th;
-	GLfloat u2 = srcRectangle == NULL ? 1 : u1 + (srcRectangle->w / tw);
-	GLfloat v2 = srcRectangle == NULL ? 1 : v1 + (srcRectangle->h / th);
-	GLfloat tmp;
-	if (scale != NULL)
+	while (*str != '\0')
 	{
-		w *= scale->x;
-		h *= scale->y;
+		hash ^= (unsigned char)*str++;
+		hash *= FNV_PRIME;
 	}
-	if (origin == NULL)
+	return hash;
+}
+
+static unsigned int hash_program(const char *vert, const char *frag,
+								 const char *const *defines)
+{
+	unsigned int defines_hash = 0;
+	/* hashes the terminating zero too, so the sources can't run together */
+	unsigned int hash = hash_string(FNV_OFFSET, vert) * FNV_PRIME;
+	hash = hash_string(hash, frag) * FNV_PRIME;
+	/* the sum doesn't depend on the order of the defines */
+	for (; defines != NULL && *defines != NULL; defines++)
 	{
-		dx = 0;
-		dy = 0;
+		defines_hash += hash_string(FNV_OFFSET, *defines);
 	}
-	else
+	return defines_hash == 0 ? hash : (hash ^ defines_hash) * FNV_PRIME;
+}
+
+/* DJB2 hash of the sources and defines mixed with their lengths. It's
+ * stored in the cache files and compared before the binary is loaded, so a
+ * collision of the FNV hashes doesn't load the binary of another program */
+static unsigned int check_string(unsigned int check, const char *str)
+{
+	const char *start = str;
+	while (*str != '\0')
 	{
-		dx = -origin->x;
-		dy = -origin->y;
+		check = check * 33u + (unsigned char)*str++;
 	}
-	p_tl.x = x + dx * _cos - dy * _sin;
-	p_tl.y = y + dx * _sin + dy * _cos;
-	p_tr.x = x + (dx + w) * _cos - dy * _sin;
-	p_tr.y = y + (dx + w) * _sin + dy * _cos;
-	p_bl.x = x + dx * _cos - (dy + h) * _sin;
-	p_bl.y = y + dx * _sin + (dy + h) * _cos;
-	p_br.x = x + (dx + w) * _cos - (dy + h) * _sin;
-	p_br.y = y + (dx + w) * _sin + (dy + h) * _cos;
+	return check * 33u + (unsigned int)(str - start);
+}
 
-	/* calculate texture coordinates */
-	switch (effects)
+static unsigned int check_program(const char *vert, const char *frag,
+								  const char *const *defines)
+{
+	unsigned int defines_check = 0;
+	unsigned int check = check_string(check_string(5381u, vert), frag);
+	/* the sum doesn't depend on the order of the defines */
+	for (; defines != NULL && *defines != NULL; defines++)
 	{
-	case FLIP_H:
-		swap(tmp, u1, u2);
-		break;
-	case FLIP_V:
-		swap(tmp, v1, v2);
-		break;
-	case BOTH:
-		swap(tmp, u1, u2);
-		swap(tmp, v1, v2);
-		break;
-	default:
-		break;
+		defines_check += check_string(5381u, *defines);
 	}
-	t_tl.x = u1;
-	t_tl.y = v1;
-	t_tr.x = u2;
-	t_tr.y = v1;
-	t_bl.x = u1;
-	t_bl.y = v2;
-	t_br.x = u2;
-	t_br.y = v2;
-	/* set the vertex values */
-	set_vertex(0, x, p_tl.x);
-	set_vertex(0, y, p_tl.y);
-	set_vertex(0, u, t_tl.x);
-	set_vertex(0, v, t_tl.y);
-	set_vertex(2, x, p_tr.x);
-	set_vertex(2, y, p_tr.y);
-	set_vertex(2, u, t_tr.x);
-	set_vertex(2, v, t_tr.y);
-	set_vertex(3, x, p_br.x);
-	set_vertex(3, y, p_br.y);
-	set_vertex(3, u, t_br.x);
-	set_vertex(3, v, t_br.y);
-	set_vertex(1, x, p_bl.x);
-	set_vertex(1, y, p_bl.y);
-	set_vertex(1, u, t_bl.x);
-	set_vertex(1, v, t_bl.y);
-
-	set_all_vertices(r, color.x);
-	set_all_vertices(g, color.y);
-	set_all_vertices(b, color.z);
-	set_all_vertices(a, color.w);
-	return quad;
+	return check ^ defines_check;
 }
 
-inline static struct BLZ_SpriteQuad transform(
-	const struct BLZ_Texture *texture,
-	const struct BLZ_Vector2 position,
-	const struct BLZ_Rectangle *srcRectangle,
-	float rotation,
-	const struct BLZ_Vector2 *origin,
-	const struct BLZ_Vector2 *scale,
-	const struct BLZ_Vector4 color,
-	enum BLZ_SpriteFlip effects)
+static void load_program_binary(glGetProcAddress loader)
 {
-	if (srcRectangle == NULL && rotation == 0.0f && origin == NULL &&
-		scale == NULL && effects == NONE)
+	GLint formats = 0;
+	__getProgramBinary = NULL;
+	__programBinary = NULL;
+	__programParameteri = NULL;
+	/* the programs of the previous context are gone */
+	warmProgramCount = 0;
+	if (GLVersion.major < 4 || (GLVersion.major == 4 && GLVersion.minor < 1))
+	{
+		if (!has_extension("GL_ARB_get_program_binary"))
+		{
+			return;
+		}
+	}
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0)
 	{
-		return transform_position_fastpath(texture, position, color);
+		return;
 	}
-	else
+	load_function(loader, "glGetProgramBinary", &__getProgramBinary);
+	load_function(loader, "glProgramBinary", &__programBinary);
+	load_function(loader, "glProgramParameteri", &__programParameteri);
+	if (__getProgramBinary == NULL || __programBinary == NULL)
 	{
-		return transform_full(texture, position, srcRectangle, rotation,
-							  origin, scale, color, effects);
+		__getProgramBinary = NULL;
+		__programBinary = NULL;
+		return;
 	}
+	driverHash = hash_string(FNV_OFFSET, (const char *)glGetString(GL_VENDOR));
+	driverHash = hash_string(driverHash * FNV_PRIME,
+							 (const char *)glGetString(GL_RENDERER));
+	driverHash = hash_string(driverHash * FNV_PRIME,
+							 (const char *)glGetString(GL_VERSION));
 }
 
-int BLZ_Draw(
-	struct BLZ_SpriteBatch *batch,
-	const struct BLZ_Texture *texture,
-	const struct BLZ_Vector2 position,
-	const struct BLZ_Rectangle *srcRectangle,
-	float rotation,
-	const struct BLZ_Vector2 *origin,
-	const struct BLZ_Vector2 *scale,
-	const struct BLZ_Vector4 color,
-	enum BLZ_SpriteFlip effects)
+static int is_cache_enabled()
 {
-	struct BLZ_SpriteQuad quad = transform(
-		texture,
-		position,
-		srcRectangle,
-		rotation,
-		origin,
-		scale,
-		color,
-		effects);
-	return BLZ_LowerDraw(batch, texture->id, &quad);
+	return shaderCacheDir[0] != '\0' && __programBinary != NULL;
+}
+
+static void *alloc_binary(GLint length)
+{
+#ifdef BLZ_CONFIG_STATIC
+	/* longer binaries are not cached */
+	return length <= BLZ_PROGRAM_BINARY_SIZE ? __scratch.binary : NULL;
+#else
+	return blz_malloc(MEMORY_SHADERS, (size_t)length);
+#endif
+}
+
+static void free_binary(void *binary)
+{
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(binary);
+#endif
+}
+
+static GLuint create_program_from_binary(GLenum format, const void *binary,
+										 GLint length)
+{
+	GLint is_linked;
+	GLuint program = glCreateProgram();
+	__programBinary(program, format, binary, length);
+	glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+	if (is_linked)
+	{
+		return program;
+	}
+	/* the binary was rejected by the driver, clear the errors it made */
+	while (glGetError() != GL_NO_ERROR)
+	{
+	};
+	glDeleteProgram(program);
+	return 0;
+}
+
+/* reads the next program of the cache index, BLZ_FALSE at the end of the
+ * file, the lines of the older versions are skipped */
+static int read_index_line(FILE *file, unsigned int *hash,
+						   unsigned int *driver, unsigned int *check)
+{
+	char line[CACHE_LINE_SIZE];
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (sscanf(line, "%x %x %x", hash, driver, check) == 3)
+		{
+			return BLZ_TRUE;
+		}
+	}
+	return BLZ_FALSE;
+}
+
+static GLuint load_program_file(unsigned int hash, unsigned int check)
+{
+	FILE *file;
+	void *binary;
+	char path[CACHE_PATH_SIZE];
+	struct ProgramFileHeader header;
+	GLuint program = 0;
+	sprintf(path, "%s/blz_%08x%08x.bin", shaderCacheDir, hash, driverHash);
+	file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	if (fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == CACHE_MAGIC &&
+		header.version == CACHE_VERSION &&
+		header.source_hash == hash &&
+		header.source_check == check &&
+		header.driver_hash == driverHash &&
+		header.length > 0)
+	{
+		binary = alloc_binary(header.length);
+		if (binary != NULL &&
+			fread(binary, 1, (size_t)header.length, file) == (size_t)header.length)
+		{
+			program = create_program_from_binary(header.format, binary,
+												 header.length);
+		}
+		free_binary(binary);
+	}
+	fclose(file);
+	return program;
+}
+
+/* BLZ_TRUE if the index already lists the program for the current driver */
+static int is_program_indexed(const char *path, unsigned int hash,
+							  unsigned int check)
+{
+	unsigned int indexed, driver, indexed_check;
+	int is_found = BLZ_FALSE;
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+	{
+		return BLZ_FALSE;
+	}
+	while (!is_found && read_index_line(file, &indexed, &driver, &indexed_check))
+	{
+		is_found = indexed == hash && driver == driverHash &&
+				   indexed_check == check;
+	}
+	fclose(file);
+	return is_found;
+}
+
+static void save_program_file(GLuint program, unsigned int hash,
+							  unsigned int check)
+{
+	FILE *file;
+	void *binary;
+	char path[CACHE_PATH_SIZE];
+	struct ProgramFileHeader header;
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0 || (binary = alloc_binary(length)) == NULL)
+	{
+		return;
+	}
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.source_hash = hash;
+	header.source_check = check;
+	header.driver_hash = driverHash;
+	__getProgramBinary(program, length, &header.length, &header.format, binary);
+	sprintf(path, "%s/blz_%08x%08x.bin", shaderCacheDir, hash, driverHash);
+	if (header.length > 0 && (file = fopen(path, "wb")) != NULL)
+	{
+		fwrite(&header, sizeof(header), 1, file);
+		fwrite(binary, 1, (size_t)header.length, file);
+		fclose(file);
+		/* remember the program for BLZ_WarmUpShaderCache, the binary which
+		 * replaces a rejected one is listed already */
+		sprintf(path, "%s/" CACHE_INDEX, shaderCacheDir);
+		if (!is_program_indexed(path, hash, check) &&
+			(file = fopen(path, "a")) != NULL)
+		{
+			fprintf(file, "%08x %08x %08x\n", hash, driverHash, check);
+			fclose(file);
+		}
+	}
+	free_binary(binary);
+}
+
+static int find_warm_program(unsigned int hash, unsigned int check)
+{
+	int i;
+	for (i = 0; i < warmProgramCount; i++)
+	{
+		if (warmPrograms[i].hash == hash && warmPrograms[i].check == check)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* returns a linked program for the specified sources hashes, or 0 */
+static GLuint take_cached_program(unsigned int hash, unsigned int check)
+{
+	GLuint program;
+	int i = find_warm_program(hash, check);
+	if (i < 0)
+	{
+		return load_program_file(hash, check);
+	}
+	program = warmPrograms[i].program;
+	warmPrograms[i] = warmPrograms[--warmProgramCount];
+	return program;
+}
+
+static void release_warm_programs()
+{
+	while (warmProgramCount > 0)
+	{
+		glDeleteProgram(warmPrograms[--warmProgramCount].program);
+	}
+}
+
+/* Parallel shader compilation */
+#ifndef GL_COMPLETION_STATUS
+#define GL_COMPLETION_STATUS 0x91B1
+#endif
+/* lets the driver choose the count of compiler threads */
+#define ANY_THREAD_COUNT 0xFFFFFFFFu
+
+typedef void(APIENTRYP MaxShaderCompilerThreadsFunc)(GLuint count);
+
+/* BLZ_TRUE if the link status can be polled without blocking */
+static int isParallelCompile = BLZ_FALSE;
+
+static void load_parallel_compile(glGetProcAddress loader)
+{
+	MaxShaderCompilerThreadsFunc max_threads = NULL;
+	isParallelCompile = BLZ_FALSE;
+	if (has_extension("GL_KHR_parallel_shader_compile"))
+	{
+		load_function(loader, "glMaxShaderCompilerThreadsKHR", &max_threads);
+	}
+	else if (has_extension("GL_ARB_parallel_shader_compile"))
+	{
+		load_function(loader, "glMaxShaderCompilerThreadsARB", &max_threads);
+	}
+	if (max_threads != NULL)
+	{
+		max_threads(ANY_THREAD_COUNT);
+		isParallelCompile = BLZ_TRUE;
+	}
+}
+
+/* Public API */
+int BLZ_SetAllocator(
+	BLZ_AllocFunc alloc,
+	BLZ_ReallocFunc realloc,
+	BLZ_FreeFunc free,
+	void *user_data)
+{
+#ifdef BLZ_CONFIG_STATIC
+	fail("Custom allocators are not available in static configuration");
+#else
+	int i;
+	validate((alloc == NULL) == (realloc == NULL));
+	validate((alloc == NULL) == (free == NULL));
+	for (i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+	{
+		if (__memoryUsage[i] > 0)
+		{
+			fail("Can't change the allocator while the memory is in use");
+		}
+	}
+	__alloc = alloc == NULL ? default_alloc : alloc;
+	__realloc = realloc == NULL ? default_realloc : realloc;
+	__free = free == NULL ? default_free : free;
+	__allocUserData = user_data;
+	success();
+#endif
+}
+
+size_t BLZ_GetMemoryUsage(enum BLZ_MemoryCategory category)
+{
+	if (category < 0 || category >= MEMORY_CATEGORY_COUNT)
+	{
+		return 0;
+	}
+	return __memoryUsage[category];
+}
+
+int BLZ_TrimVertexPool()
+{
+#ifndef BLZ_CONFIG_STATIC
+	union VertexPage *page;
+	while (__freePages != NULL)
+	{
+		page = __freePages;
+		__freePages = page->next;
+		blz_free(page);
+	}
+#endif
+	success();
+}
+
+int BLZ_InvalidateGLState()
+{
+	invalidate_state();
+	uniformEpoch++;
+	rebind_uniform_buffers();
+	success();
+}
+
+char* BLZ_GetLastError()
+{
+	return __lastError;
+}
+
+int BLZ_Load(glGetProcAddress loader)
+{
+	int result = gladLoadGLLoader((GLADloadproc)loader);
+	fail_if_false(result, "Could not load the OpenGL library");
+	invalidate_state();
+	load_uniform_buffers(loader);
+	load_program_binary(loader);
+	load_parallel_compile(loader);
+	/* the variants of the previous context are gone */
+	variantShaders = NULL;
+	SHADER_OPAQUE = NULL;
+	SHADER_DEFAULT = BLZ_CompileShaderVariant(vertexSource, fragmentSource, NULL);
+	fail_if_false(SHADER_DEFAULT, "Could not compile default shader");
+	fail_if_false(BLZ_UseShader(SHADER_DEFAULT), "Could not use default shader");
+	immediateBuf = create_buffer(1, GL_STREAM_DRAW);
+	/* the coalesced sprites and the ring of the previous context are gone,
+	 * the mode is kept */
+	immediateCount = 0;
+	immediateTexture = 0;
+	if (immediateMode == IMMEDIATE_COALESCE)
+	{
+		immediateRing = create_buffer(BLZ_IMMEDIATE_RING_SIZE, GL_STREAM_DRAW);
+		immediateRingOffset = 0;
+	}
+	/* the depth buffer is written only by the opaque batches, which enable
+	 * the depth test, but it's cleared by BLZ_Clear */
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_BLEND);
+	success();
+}
+
+int BLZ_GetMaxTextureSlots()
+{
+	GLint result;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &result);
+	return result;
+}
+
+int BLZ_BindTexture(struct BLZ_Texture *texture, int slot)
+{
+	GLuint id = texture == NULL ? 0 : texture->id;
+	validate(slot >= 0);
+	flush_immediate();
+	state_bind_texture(slot, id);
+	if (slot == 0)
+	{
+		tex0_override = id;
+	}
+	success();
+}
+
+int BLZ_SetTextureFiltering(
+	struct BLZ_Texture *texture,
+	enum BLZ_TextureFilter minification,
+	enum BLZ_TextureFilter magnification)
+{
+	GLuint previous;
+	flush_immediate();
+	previous = state_bind_texture_any(texture->id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minification);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magnification);
+	state_restore_texture_any(previous);
+	success();
+}
+
+int BLZ_SetTextureWrap(
+	struct BLZ_Texture *texture,
+	enum BLZ_TextureWrap x,
+	enum BLZ_TextureWrap y)
+{
+	GLuint previous;
+	flush_immediate();
+	previous = state_bind_texture_any(texture->id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, x);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, y);
+	state_restore_texture_any(previous);
+	success();
+}
+
+static void bind_tex0(GLuint tex)
+{
+	if (tex0_override == 0)
+	{
+		state_bind_texture(0, tex);
+	}
+}
+
+int BLZ_GetOptions(const struct BLZ_SpriteBatch *batch,
+				   int *max_buckets, int *max_sprites_per_bucket,
+				   enum BLZ_InitFlags *flags)
+{
+	validate(batch != NULL);
+	if (batch->max_buckets <= 0 || batch->max_sprites_per_bucket <= 0)
+	{
+		fail("Not initialized");
+	}
+	*max_buckets = batch->max_buckets;
+	*max_sprites_per_bucket = batch->max_sprites_per_bucket;
+	*flags = batch->flags;
+	success();
+}
+
+int BLZ_SetViewport(int w, int h)
+{
+	validate(w > 0);
+	validate(h > 0);
+	flush_immediate();
+	if (orthoMatrix[0] == 2.0f / (GLfloat)w &&
+		orthoMatrix[5] == -2.0f / (GLfloat)h)
+	{
+		success();
+	}
+	orthoMatrix[0] = 2.0f / (GLfloat)w;
+	orthoMatrix[5] = -2.0f / (GLfloat)h;
+	/* 0 is reserved for custom matrices */
+	if (++orthoGeneration == 0)
+	{
+		orthoGeneration = 1;
+	}
+	memcpy(frameData.projection, orthoMatrix, sizeof(orthoMatrix));
+	frameData.resolution[0] = (GLfloat)w;
+	frameData.resolution[1] = (GLfloat)h;
+	upload_frame_data();
+	success();
+}
+
+void BLZ_SetClearColor(struct BLZ_Vector4 color)
+{
+	currentClearColor = color;
+	glClearColor(color.x, color.y, color.z, color.w);
+}
+
+void BLZ_SetBlendMode(const struct BLZ_BlendFunc func)
+{
+	flush_immediate();
+	currentBlend = func;
+	state_blend_func(func.source, func.destination);
+}
+
+void BLZ_SetPremultipliedAlpha(int enabled)
+{
+	premultipliedAlpha = enabled != 0;
+	BLZ_SetBlendMode(premultipliedAlpha ? BLEND_PREMULTIPLIED : BLEND_NORMAL);
+}
+
+struct BLZ_Vector4 BLZ_PremultiplyColor(struct BLZ_Vector4 color, float additive)
+{
+	struct BLZ_Vector4 result;
+	additive = additive < 0.0f ? 0.0f : (additive > 1.0f ? 1.0f : additive);
+	result.x = color.x * color.w;
+	result.y = color.y * color.w;
+	result.z = color.z * color.w;
+	/* zero alpha keeps the destination, which makes the sprite additive */
+	result.w = color.w * (1.0f - additive);
+	return result;
+}
+
+void BLZ_Clear()
+{
+	flush_immediate();
+	if (__activeQueue != NULL)
+	{
+		queue_clear();
+		return;
+	}
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	*currentDepthSlice = 0;
+}
+
+static void print_info_log(const char *message, GLuint object, int is_program)
+{
+	int log_length;
+	char *log_string;
+	if (is_program)
+	{
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &log_length);
+	}
+	else
+	{
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &log_length);
+	}
+#ifdef BLZ_CONFIG_STATIC
+	log_string = __scratch.log;
+	if (log_length > BLZ_SHADER_LOG_SIZE)
+	{
+		log_length = BLZ_SHADER_LOG_SIZE;
+	}
+#else
+	log_string = blz_malloc(MEMORY_TEMPORARY, log_length);
+	if (log_string == NULL)
+	{
+		printf("%s\n", message);
+		return;
+	}
+#endif
+	if (is_program)
+	{
+		glGetProgramInfoLog(object, log_length, &log_length, log_string);
+	}
+	else
+	{
+		glGetShaderInfoLog(object, log_length, &log_length, log_string);
+	}
+	printf("%s: %s\n", message, log_string);
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(log_string);
+#endif
+}
+
+static int count_defines(const char *const *defines)
+{
+	int count = 0;
+	while (defines != NULL && defines[count] != NULL)
+	{
+		count++;
+	}
+	return count;
+}
+
+/* size of the defines with the terminating zeros */
+static size_t defines_size(const char *const *defines)
+{
+	size_t size = 0;
+	for (; defines != NULL && *defines != NULL; defines++)
+	{
+		size += strlen(*defines) + 1;
+	}
+	return size;
+}
+
+static int keep_defines(struct BLZ_Shader *shader, const char *const *defines)
+{
+	size_t length, offset = 0;
+#ifndef BLZ_CONFIG_STATIC
+	if (defines_size(defines) > 0)
+	{
+		shader->defines = blz_malloc(MEMORY_SHADERS, defines_size(defines));
+		check_alloc(shader->defines);
+	}
+#endif
+	for (; defines != NULL && *defines != NULL; defines++)
+	{
+		length = strlen(*defines) + 1;
+		memcpy(shader->defines + offset, *defines, length);
+		offset += length;
+		shader->define_count++;
+	}
+	success();
+}
+
+/* the defines are a set, so the order doesn't matter like in hash_program */
+static int has_defines(const struct BLZ_Shader *shader,
+					   const char *const *defines)
+{
+	int i;
+	const char *kept;
+	if (count_defines(defines) != shader->define_count)
+	{
+		return BLZ_FALSE;
+	}
+	for (; defines != NULL && *defines != NULL; defines++)
+	{
+		kept = shader->defines;
+		for (i = 0; i < shader->define_count && strcmp(kept, *defines) != 0; i++)
+		{
+			kept += strlen(kept) + 1;
+		}
+		if (i == shader->define_count)
+		{
+			return BLZ_FALSE;
+		}
+	}
+	return BLZ_TRUE;
+}
+
+/* The compilation status is queried when the program is finished, so the
+ * driver can compile the shaders in parallel. The defines are inserted
+ * after the #version line. */
+static GLuint start_shader(GLenum type, const char *src,
+						   const char *const *defines)
+{
+	const GLchar *strings[2 + MAX_SHADER_DEFINES * 3];
+	GLint lengths[2 + MAX_SHADER_DEFINES * 3];
+	GLsizei count = 0;
+	const char *body = src;
+	GLuint shader = glCreateShader(type);
+	while (*body == ' ' || *body == '\t' || *body == '\r' || *body == '\n')
+	{
+		body++;
+	}
+	if (strncmp(body, "#version", 8) == 0 && strchr(body, '\n') != NULL)
+	{
+		body = strchr(body, '\n') + 1;
+		strings[count] = src;
+		lengths[count++] = (GLint)(body - src);
+	}
+	else
+	{
+		body = src;
+	}
+	for (; defines != NULL && *defines != NULL; defines++)
+	{
+		strings[count] = "#define ";
+		lengths[count++] = -1;
+		strings[count] = *defines;
+		lengths[count++] = -1;
+		strings[count] = "\n";
+		lengths[count++] = -1;
+	}
+	strings[count] = body;
+	lengths[count++] = -1;
+	glShaderSource(shader, count, strings, lengths);
+	glCompileShader(shader);
+	return shader;
+}
+
+/* fills the uniform location cache, the uniforms which don't fit are
+ * looked up by the driver */
+static int introspect_uniforms(struct BLZ_Shader *shader)
+{
+	GLint count, size, i;
+	GLsizei length;
+	GLenum type;
+	int capacity;
+	struct Uniform *uniform;
+	glGetProgramiv(shader->program, GL_ACTIVE_UNIFORMS, &count);
+	shader->uniform_count = 0;
+#ifdef BLZ_CONFIG_STATIC
+	capacity = BLZ_MAX_UNIFORMS;
+#else
+	capacity = count;
+	shader->uniforms = NULL;
+	if (count > 0)
+	{
+		shader->uniforms = blz_malloc(MEMORY_SHADERS, count * sizeof(struct Uniform));
+		check_alloc(shader->uniforms);
+	}
+#endif
+	for (i = 0; i < count && shader->uniform_count < capacity; i++)
+	{
+		uniform = shader->uniforms + shader->uniform_count;
+		glGetActiveUniform(shader->program, (GLuint)i, UNIFORM_NAME_SIZE,
+						   &length, &size, &type, uniform->name);
+		if (length <= 0 || length >= UNIFORM_NAME_SIZE - 1)
+		{
+			/* possibly truncated */
+			continue;
+		}
+		/* arrays are reported as "name[0]" */
+		if (length > 3 && strcmp(uniform->name + length - 3, "[0]") == 0)
+		{
+			uniform->name[length - 3] = '\0';
+		}
+		uniform->location = glGetUniformLocation(shader->program, uniform->name);
+		if (uniform->location < 0)
+		{
+			/* built-in variables and uniform block members */
+			continue;
+		}
+		uniform->value_size = 0;
+		shader->uniform_count++;
+	}
+	shader->epoch = uniformEpoch;
+	shader->mvp_generation = 0;
+	shader->is_mvp_known = GL_FALSE;
+	success();
+}
+
+static struct Uniform *find_uniform(struct BLZ_Shader *shader, GLint location)
+{
+	int i;
+	for (i = 0; i < shader->uniform_count; i++)
+	{
+		if (shader->uniforms[i].location == location)
+		{
+			return shader->uniforms + i;
+		}
+	}
+	return NULL;
+}
+
+/* drops the shadow copies if the OpenGL state was invalidated */
+static void refresh_shadows(struct BLZ_Shader *shader)
+{
+	int i;
+	if (shader->epoch == uniformEpoch)
+	{
+		return;
+	}
+	for (i = 0; i < shader->uniform_count; i++)
+	{
+		shader->uniforms[i].value_size = 0;
+	}
+	shader->is_mvp_known = GL_FALSE;
+	shader->epoch = uniformEpoch;
+}
+
+/* uploads the MVP matrix to the bound shader unless it has it already,
+ * generation is orthoGeneration for orthoMatrix and 0 for the others */
+static void shader_set_mvp(
+	struct BLZ_Shader *shader,
+	const GLfloat *matrix,
+	unsigned int generation)
+{
+	if (shader->mvp_param < 0)
+	{
+		return;
+	}
+	refresh_shadows(shader);
+	if (shader->is_mvp_known &&
+		((generation != 0 && shader->mvp_generation == generation) ||
+		 memcmp(shader->mvp, matrix, sizeof(shader->mvp)) == 0))
+	{
+		shader->mvp_generation = generation;
+		return;
+	}
+	glUniformMatrix4fv(shader->mvp_param, 1, GL_FALSE, matrix);
+	memcpy(shader->mvp, matrix, sizeof(shader->mvp));
+	shader->mvp_generation = generation;
+	shader->is_mvp_known = GL_TRUE;
+}
+
+/* Returns BLZ_TRUE if the uniform of the current shader already has the
+ * specified value, otherwise remembers it. Size of 0 means that the value
+ * can't be shadowed. */
+static int is_uniform_unchanged(GLint location, const void *value, GLsizei size)
+{
+	struct Uniform *uniform;
+	struct BLZ_Shader *shader = SHADER_CURRENT;
+	if (shader == NULL || location < 0)
+	{
+		return BLZ_FALSE;
+	}
+	refresh_shadows(shader);
+	if (location == shader->mvp_param)
+	{
+		/* the MVP matrix has its own shadow copy */
+		shader->is_mvp_known = GL_FALSE;
+		return BLZ_FALSE;
+	}
+	uniform = find_uniform(shader, location);
+	if (uniform == NULL)
+	{
+		return BLZ_FALSE;
+	}
+	if (size > 0 && uniform->value_size == size &&
+		memcmp(uniform->value, value, (size_t)size) == 0)
+	{
+		return BLZ_TRUE;
+	}
+	if (size <= 0 || (size_t)size > sizeof(uniform->value))
+	{
+		uniform->value_size = 0;
+		return BLZ_FALSE;
+	}
+	memcpy(uniform->value, value, (size_t)size);
+	uniform->value_size = size;
+	return BLZ_FALSE;
+}
+
+static GLint uniform_location(const struct BLZ_Shader *shader, const char *name)
+{
+	int i;
+	size_t length = strlen(name);
+	/* "name[0]" is the same uniform as "name" */
+	if (length > 3 && strcmp(name + length - 3, "[0]") == 0)
+	{
+		length -= 3;
+	}
+	for (i = 0; i < shader->uniform_count; i++)
+	{
+		if (strncmp(shader->uniforms[i].name, name, length) == 0 &&
+			shader->uniforms[i].name[length] == '\0')
+		{
+			return shader->uniforms[i].location;
+		}
+	}
+	return glGetUniformLocation(shader->program, (const GLchar *)name);
+}
+
+static void start_program(struct BLZ_Shader *shader, const char *vert,
+						  const char *frag, const char *const *defines)
+{
+	GLuint program = glCreateProgram();
+	shader->vertex_shader = start_shader(GL_VERTEX_SHADER, vert, defines);
+	shader->fragment_shader = start_shader(GL_FRAGMENT_SHADER, frag, defines);
+	glAttachShader(program, shader->vertex_shader);
+	glAttachShader(program, shader->fragment_shader);
+	glBindAttribLocation(program, 0, "in_Position");
+	glBindAttribLocation(program, 1, "in_Texcoord");
+	glBindAttribLocation(program, 2, "in_Color");
+	glBindAttribLocation(program, FIRST_CHANNEL_LOCATION + 0, "in_Channel0");
+	glBindAttribLocation(program, FIRST_CHANNEL_LOCATION + 1, "in_Channel1");
+	glBindAttribLocation(program, FIRST_CHANNEL_LOCATION + 2, "in_Channel2");
+	glBindAttribLocation(program, FIRST_CHANNEL_LOCATION + 3, "in_Channel3");
+	glBindAttribLocation(program, DEPTH_LOCATION, "in_Depth");
+	if (is_cache_enabled() && __programParameteri != NULL)
+	{
+		__programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(program);
+	shader->program = program;
+}
+
+static void print_program_errors(struct BLZ_Shader *shader)
+{
+	GLint is_compiled;
+	GLuint objects[2];
+	int i, has_errors = BLZ_FALSE;
+	objects[0] = shader->vertex_shader;
+	objects[1] = shader->fragment_shader;
+	for (i = 0; i < 2; i++)
+	{
+		if (objects[i] == 0)
+		{
+			continue;
+		}
+		glGetShaderiv(objects[i], GL_COMPILE_STATUS, &is_compiled);
+		if (!is_compiled)
+		{
+			print_info_log("Error compiling shader", objects[i], BLZ_FALSE);
+			has_errors = BLZ_TRUE;
+		}
+	}
+	if (!has_errors)
+	{
+		print_info_log("Error linking shader", shader->program, BLZ_TRUE);
+	}
+}
+
+static void delete_shader_objects(struct BLZ_Shader *shader)
+{
+	/* the attached ones are deleted along with the program */
+	glDeleteShader(shader->vertex_shader);
+	glDeleteShader(shader->fragment_shader);
+	shader->vertex_shader = 0;
+	shader->fragment_shader = 0;
+}
+
+/* Waits for the pending program and prepares it for use, returns BLZ_TRUE
+ * if the shader is ready. */
+static int finish_shader(struct BLZ_Shader *shader)
+{
+	GLint is_linked;
+	if (shader->status != SHADER_PENDING)
+	{
+		return shader->status == SHADER_READY;
+	}
+	glGetProgramiv(shader->program, GL_LINK_STATUS, &is_linked);
+	if (!is_linked)
+	{
+		print_program_errors(shader);
+	}
+	delete_shader_objects(shader);
+	if (!is_linked || !introspect_uniforms(shader))
+	{
+		glDeleteProgram(shader->program);
+		shader->program = 0;
+		shader->status = SHADER_FAILED;
+		return BLZ_FALSE;
+	}
+	if (shader->needs_saving && is_cache_enabled())
+	{
+		save_program_file(shader->program, shader->hash, shader->check);
+	}
+	shader->mvp_param = uniform_location(shader, "u_mvpMatrix");
+	bind_uniform_blocks(shader);
+	shader->status = SHADER_READY;
+	return BLZ_TRUE;
+}
+
+GLint BLZ_GetUniformLocation(const struct BLZ_Shader *shader, const char *name)
+{
+	if (shader == NULL || name == NULL)
+	{
+		return -1;
+	}
+	/* the uniforms of a pending program are known once it's linked */
+	if (shader->status == SHADER_PENDING &&
+		!finish_shader((struct BLZ_Shader *)shader))
+	{
+		return -1;
+	}
+	return uniform_location(shader, name);
+}
+
+static void release_shader(struct BLZ_Shader *shader)
+{
+	struct BLZ_Shader **link = &variantShaders;
+	while (shader->is_variant && *link != NULL)
+	{
+		if (*link == shader)
+		{
+			*link = shader->next_variant;
+			break;
+		}
+		link = &(*link)->next_variant;
+	}
+	if (glState.program == shader->program)
+	{
+		glState.program = UNKNOWN;
+	}
+	delete_shader_objects(shader);
+	glDeleteProgram(shader->program);
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(shader->uniforms);
+	blz_free(shader->defines);
+#endif
+	delete_object(shaderPool, shader);
+}
+
+static struct BLZ_Shader *start_compile(const char *vert, const char *frag,
+										const char *const *defines,
+										unsigned int hash)
+{
+	struct BLZ_Shader *shader;
+	GLuint program = 0;
+	unsigned int check = 0;
+	if (is_cache_enabled())
+	{
+		check = check_program(vert, frag, defines);
+		program = take_cached_program(hash, check);
+	}
+	shader = new_object(shaderPool, MEMORY_SHADERS, struct BLZ_Shader);
+	if (shader == NULL)
+	{
+		glDeleteProgram(program);
+		return NULL;
+	}
+	shader->uniform_count = 0;
+#ifndef BLZ_CONFIG_STATIC
+	shader->uniforms = NULL;
+	shader->defines = NULL;
+#endif
+	shader->define_count = 0;
+	shader->mvp_param = -1;
+	shader->blocks_generation = uniformBlocksGeneration;
+	shader->status = SHADER_PENDING;
+	shader->vertex_shader = 0;
+	shader->fragment_shader = 0;
+	shader->hash = hash;
+	shader->check = check;
+	shader->references = 1;
+	shader->is_variant = GL_FALSE;
+	shader->next_variant = NULL;
+	/* the programs from the cache don't need to be saved again */
+	shader->needs_saving = program == 0;
+	if (program)
+	{
+		shader->program = program;
+	}
+	else
+	{
+		start_program(shader, vert, frag, defines);
+	}
+	return shader;
+}
+
+static struct BLZ_Shader *compile(const char *vert, const char *frag,
+								  const char *const *defines, unsigned int hash)
+{
+	struct BLZ_Shader *shader = start_compile(vert, frag, defines, hash);
+	if (shader == NULL)
+	{
+		return NULL;
+	}
+	if (!finish_shader(shader))
+	{
+		release_shader(shader);
+		return NULL;
+	}
+	return shader;
+}
+
+BLZ_Shader *BLZ_CompileShaderAsync(const char *vert, const char *frag)
+{
+	null_if_invalid(vert != NULL);
+	null_if_invalid(frag != NULL);
+	return start_compile(vert, frag, NULL, hash_program(vert, frag, NULL));
+}
+
+BLZ_Shader *BLZ_CompileShader(const char *vert, const char *frag)
+{
+	null_if_invalid(vert != NULL);
+	null_if_invalid(frag != NULL);
+	return compile(vert, frag, NULL, hash_program(vert, frag, NULL));
+}
+
+BLZ_Shader *BLZ_CompileShaderVariant(const char *vert, const char *frag,
+									 const char *const *defines)
+{
+	unsigned int hash;
+	struct BLZ_Shader *shader;
+	null_if_invalid(vert != NULL);
+	null_if_invalid(frag != NULL);
+	null_if_invalid(count_defines(defines) <= MAX_SHADER_DEFINES);
+#ifdef BLZ_CONFIG_STATIC
+	null_if_invalid(defines_size(defines) <= BLZ_VARIANT_DEFINES_SIZE);
+#endif
+	hash = hash_program(vert, frag, defines);
+	for (shader = variantShaders; shader != NULL; shader = shader->next_variant)
+	{
+		if (shader->hash == hash && has_defines(shader, defines))
+		{
+			shader->references++;
+			return shader;
+		}
+	}
+	shader = compile(vert, frag, defines, hash);
+	if (shader != NULL && !keep_defines(shader, defines))
+	{
+		release_shader(shader);
+		return NULL;
+	}
+	if (shader != NULL)
+	{
+		shader->is_variant = GL_TRUE;
+		shader->next_variant = variantShaders;
+		variantShaders = shader;
+	}
+	return shader;
+}
+
+BLZ_Shader *BLZ_GetDefaultShaderVariant(const char *const *defines)
+{
+	return BLZ_CompileShaderVariant(vertexSource, fragmentSource, defines);
+}
+
+enum BLZ_ShaderStatus BLZ_PollShader(struct BLZ_Shader *shader)
+{
+	GLint is_completed = GL_TRUE;
+	if (shader == NULL)
+	{
+		return SHADER_FAILED;
+	}
+	if (shader->status == SHADER_PENDING && isParallelCompile)
+	{
+		glGetProgramiv(shader->program, GL_COMPLETION_STATUS, &is_completed);
+	}
+	if (is_completed)
+	{
+		finish_shader(shader);
+	}
+	return shader->status;
+}
+
+int BLZ_SetShaderCacheDir(const char *path)
+{
+	release_warm_programs();
+	if (path == NULL)
+	{
+		shaderCacheDir[0] = '\0';
+		success();
+	}
+	validate(strlen(path) > 0 && strlen(path) < CACHE_DIR_SIZE);
+	strcpy(shaderCacheDir, path);
+	success();
+}
+
+int BLZ_WarmUpShaderCache()
+{
+	FILE *file;
+	GLuint program;
+	unsigned int hash, driver, check;
+	char path[CACHE_PATH_SIZE];
+	fail_if_false(is_cache_enabled(), "Program binary cache is not available");
+	sprintf(path, "%s/" CACHE_INDEX, shaderCacheDir);
+	file = fopen(path, "r");
+	if (file == NULL)
+	{
+		/* nothing is cached yet */
+		success();
+	}
+	while (warmProgramCount < BLZ_MAX_CACHED_PROGRAMS &&
+		   read_index_line(file, &hash, &driver, &check))
+	{
+		if (driver != driverHash || find_warm_program(hash, check) >= 0)
+		{
+			continue;
+		}
+		program = load_program_file(hash, check);
+		if (program)
+		{
+			warmPrograms[warmProgramCount].hash = hash;
+			warmPrograms[warmProgramCount].check = check;
+			warmPrograms[warmProgramCount].program = program;
+			warmProgramCount++;
+		}
+	}
+	fclose(file);
+	success();
+}
+
+int BLZ_UseShader(struct BLZ_Shader *program)
+{
+	GLenum result;
+	validate(program != NULL);
+	flush_immediate();
+	fail_if_false(finish_shader(program), "Could not compile shader program");
+	if (program->blocks_generation != uniformBlocksGeneration)
+	{
+		bind_uniform_blocks(program);
+	}
+	if (glState.program == program->program)
+	{
+		SHADER_CURRENT = program;
+		success();
+	}
+	/* clear previous errors to make sure we're reading the actual one */
+	while (glGetError() != GL_NO_ERROR)
+	{
+	};
+	glUseProgram(program->program);
+	result = glGetError();
+	if (result == GL_NO_ERROR)
+	{
+		glState.program = program->program;
+		SHADER_CURRENT = program;
+		success();
+	}
+	glState.program = UNKNOWN;
+	printf("glUseProgram: error %d\n", result);
+	fail("Could not use shader program");
+}
+
+int BLZ_FreeShader(BLZ_Shader *program)
+{
+	validate(program != NULL);
+	flush_immediate();
+	if (--program->references > 0)
+	{
+		success();
+	}
+	release_shader(program);
+	success();
+}
+
+BLZ_Shader *BLZ_GetDefaultShader()
+{
+	return SHADER_DEFAULT;
+}
+
+int BLZ_SetFrameTime(float time, float delta_time)
+{
+	flush_immediate();
+	frameData.time = time;
+	frameData.delta_time = delta_time;
+	upload_frame_data();
+	success();
+}
+
+struct BLZ_FrameData BLZ_GetFrameData()
+{
+	return frameData;
+}
+
+struct BLZ_UniformBuffer *BLZ_CreateUniformBuffer(
+	const char *block_name,
+	size_t size)
+{
+	int slot;
+	struct BLZ_UniformBuffer *buffer;
+	null_if_invalid(block_name != NULL);
+	null_if_invalid(strlen(block_name) < UNIFORM_NAME_SIZE);
+	null_if_invalid(size > 0);
+	null_if_false((frameDataBuffer != 0), "Uniform buffers are not supported");
+	for (slot = 0; slot < BLZ_MAX_UNIFORM_BUFFERS; slot++)
+	{
+		if (uniformBuffers[slot] == NULL)
+		{
+			break;
+		}
+	}
+	null_if_false((slot < BLZ_MAX_UNIFORM_BUFFERS),
+				  "Maximum count of uniform buffers reached");
+	buffer = new_object(uniformBufferPool, MEMORY_SHADERS,
+						struct BLZ_UniformBuffer);
+	check_alloc(buffer);
+	strcpy(buffer->block_name, block_name);
+	buffer->size = size;
+	buffer->binding = FRAME_DATA_BINDING + 1 + (GLuint)slot;
+	glGenBuffers(1, &buffer->id);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer->id);
+	glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, buffer->binding, buffer->id);
+	uniformBuffers[slot] = buffer;
+	/* the other shaders are connected when they're used next time */
+	uniformBlocksGeneration++;
+	if (SHADER_CURRENT != NULL)
+	{
+		flush_immediate();
+		bind_uniform_blocks(SHADER_CURRENT);
+	}
+	return buffer;
+}
+
+int BLZ_UpdateUniformBuffer(
+	struct BLZ_UniformBuffer *buffer,
+	const void *data,
+	size_t offset,
+	size_t size)
+{
+	validate(buffer != NULL);
+	validate(data != NULL);
+	validate(offset < buffer->size);
+	validate(size > 0 && size <= buffer->size - offset);
+	flush_immediate();
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer->id);
+	glBufferSubData(GL_UNIFORM_BUFFER, (GLintptr)offset, (GLsizeiptr)size,
+					data);
+	success();
+}
+
+int BLZ_FreeUniformBuffer(struct BLZ_UniformBuffer *buffer)
+{
+	validate(buffer != NULL);
+	flush_immediate();
+	uniformBuffers[buffer->binding - FRAME_DATA_BINDING - 1] = NULL;
+	glDeleteBuffers(1, &buffer->id);
+	delete_object(uniformBufferPool, buffer);
+	success();
+}
+
+static int bucket_buffer_count(const struct BLZ_SpriteBatch *batch)
+{
+	return HAS_FLAG(batch, NO_BUFFERING) ? 1 : BUFFER_COUNT;
+}
+
+static int bucket_page_count(const struct BLZ_SpriteBatch *batch)
+{
+	return (BATCH_MAX_SPRITES(batch) + SPRITES_PER_PAGE - 1) /
+		   SPRITES_PER_PAGE;
+}
+
+static void release_bucket_pages(
+	struct BLZ_SpriteBatch *batch,
+	struct SpriteBucket *bucket)
+{
+	int i;
+	for (i = 0; i < bucket_page_count(batch); i++)
+	{
+		if (bucket->pages[i] != NULL)
+		{
+			release_page(bucket->pages[i]);
+			bucket->pages[i] = NULL;
+		}
+	}
+}
+
+static int materialize_bucket(
+	struct BLZ_SpriteBatch *batch,
+	struct SpriteBucket *bucket)
+{
+	int i;
+#ifndef BLZ_CONFIG_STATIC
+	bucket->pages = blz_calloc(MEMORY_BATCHES, bucket_page_count(batch),
+							   sizeof(union VertexPage *));
+	check_alloc(bucket->pages);
+	bucket->channels = NULL;
+	if (batch->channel_stride > 0)
+	{
+		bucket->channels = blz_malloc(MEMORY_VERTICES, BATCH_MAX_SPRITES(batch) *
+														   4 * batch->channel_stride);
+		if (bucket->channels == NULL)
+		{
+			blz_free(bucket->pages);
+			fail("Could not allocate memory");
+		}
+	}
+#endif
+	for (i = 0; i < bucket_buffer_count(batch); i++)
+	{
+		/* the opaque sprites are drawn from the last one */
+		bucket->buffer[i] = create_buffer_indexed(
+			BATCH_MAX_SPRITES(batch), GL_STREAM_DRAW, GL_UNSIGNED_SHORT,
+			HAS_FLAG(batch, OPAQUE_SPRITES));
+		if (batch->channel_stride > 0)
+		{
+			add_channel_buffer(bucket->buffer + i, BATCH_MAX_SPRITES(batch),
+							   batch->channel_count, batch->channel_format,
+							   batch->channel_stride);
+		}
+	}
+	bucket->is_materialized = BLZ_TRUE;
+	bucket->last_used = batch->frame;
+	bucket->is_fresh = BLZ_TRUE;
+	success();
+}
+
+static void release_bucket(
+	struct BLZ_SpriteBatch *batch,
+	struct SpriteBucket *bucket)
+{
+	int i;
+	for (i = 0; i < bucket_buffer_count(batch); i++)
+	{
+		free_buffer(bucket->buffer[i]);
+	}
+	release_bucket_pages(batch, bucket);
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(bucket->pages);
+	blz_free(bucket->channels);
+#endif
+	memset(bucket, 0, sizeof(struct SpriteBucket));
+}
+
+int BLZ_FreeBatch(struct BLZ_SpriteBatch *batch)
+{
+	int i;
+	struct SpriteBucket *cur;
+	for (i = 0; i < BATCH_MAX_BUCKETS(batch); i++)
+	{
+		cur = batch->sprite_buckets + i;
+		if (cur->is_materialized)
+		{
+			release_bucket(batch, cur);
+		}
+	}
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(batch->sprite_buckets);
+#endif
+	delete_object(batchPool, batch);
+	success();
+}
+
+struct BLZ_SpriteBatch *BLZ_CreateBatch(
+	int max_buckets, int max_sprites_per_bucket, enum BLZ_InitFlags flags)
+{
+	return BLZ_CreateBatchEx(max_buckets, max_sprites_per_bucket, flags,
+							 0, CHANNEL_FLOAT);
+}
+
+struct BLZ_SpriteBatch *BLZ_CreateBatchEx(
+	int max_buckets,
+	int max_sprites_per_bucket,
+	enum BLZ_InitFlags flags,
+	int channel_count,
+	enum BLZ_ChannelFormat channel_format)
+{
+	struct BLZ_SpriteBatch *batch;
+	int stride;
+	null_if_invalid(max_buckets > 0);
+	null_if_invalid(max_sprites_per_bucket > 0);
+	null_if_invalid(channel_count >= 0 && channel_count <= CHANNEL_LIMIT);
+	null_if_invalid(channel_format == CHANNEL_FLOAT ||
+					channel_format == CHANNEL_UBYTE);
+	stride = channel_count * CHANNEL_SIZE(channel_format);
+	if ((flags & OPAQUE_SPRITES) == OPAQUE_SPRITES)
+	{
+		stride += sizeof(GLfloat);
+	}
+#ifdef BLZ_CONFIG_STATIC
+	null_if_invalid(max_buckets <= BLZ_MAX_BUCKETS);
+	null_if_invalid(max_sprites_per_bucket <= BLZ_MAX_SPRITES_PER_BUCKET);
+	null_if_invalid(stride <= BLZ_MAX_CHANNELS * 4 * (int)sizeof(GLfloat));
+#endif
+	batch = new_object(batchPool, MEMORY_BATCHES, struct BLZ_SpriteBatch);
+	check_alloc(batch);
+	batch->max_sprites_per_bucket = max_sprites_per_bucket;
+	batch->max_buckets = max_buckets;
+	batch->flags = flags;
+	batch->buffer_index = 0;
+	batch->frameskip = HAS_FLAG(batch, NO_BUFFERING) ? 0 : 1;
+	batch->frame = 0;
+	batch->channel_count = channel_count;
+	batch->channel_format = channel_format;
+	batch->channel_stride = stride;
+	batch->depth_sequence = 0;
+	/* the buckets are materialized on first use, see BLZ_LowerDraw */
+#ifdef BLZ_CONFIG_STATIC
+	memset(batch->sprite_buckets, 0, sizeof(batch->sprite_buckets));
+#else
+	batch->sprite_buckets = blz_calloc(MEMORY_BATCHES, batch->max_buckets,
+									   sizeof(struct SpriteBucket));
+	if (batch->sprite_buckets == NULL)
+	{
+		blz_free(batch);
+		fail("Could not allocate memory");
+	}
+#endif
+	return batch;
+}
+
+int BLZ_TrimBatch(struct BLZ_SpriteBatch *batch, int idle_frames)
+{
+	int i;
+	struct SpriteBucket *cur;
+	validate(batch != NULL);
+	validate(idle_frames >= 0);
+	for (i = 0; i < BATCH_MAX_BUCKETS(batch); i++)
+	{
+		cur = batch->sprite_buckets + i;
+		if (!cur->is_materialized || cur->sprite_count > 0)
+		{
+			continue;
+		}
+		if (batch->frame - cur->last_used - 1 >= (unsigned int)idle_frames)
+		{
+			release_bucket(batch, cur);
+		}
+	}
+	success();
+}
+
+static inline void set_mvp_matrix(const GLfloat *matrix)
+{
+	shader_set_mvp(SHADER_CURRENT, matrix,
+				   matrix == orthoMatrix ? orthoGeneration : 0);
+}
+
+static struct BLZ_SpriteBatch *__lastBatch;
+static struct SpriteBucket *__lastBucket;
+
+static void upload_bucket(const struct SpriteBucket *bucket, GLuint vbo)
+{
+	int page, count;
+	int remaining = bucket->sprite_count;
+	const GLsizeiptr page_size = SPRITES_PER_PAGE * sizeof(struct BLZ_SpriteQuad);
+	state_bind_array_buffer(vbo);
+	if (remaining <= (int)SPRITES_PER_PAGE)
+	{
+		glBufferData(GL_ARRAY_BUFFER,
+					 remaining * sizeof(struct BLZ_SpriteQuad),
+					 bucket->pages[0], GL_STREAM_DRAW);
+	}
+	else
+	{
+		/* orphan the buffer and copy the pages one by one */
+		glBufferData(GL_ARRAY_BUFFER,
+					 remaining * sizeof(struct BLZ_SpriteQuad),
+					 NULL, GL_STREAM_DRAW);
+		for (page = 0; remaining > 0; page++)
+		{
+			count = remaining < (int)SPRITES_PER_PAGE ? remaining : (int)SPRITES_PER_PAGE;
+			glBufferSubData(GL_ARRAY_BUFFER, page * page_size,
+							count * sizeof(struct BLZ_SpriteQuad),
+							bucket->pages[page]);
+			remaining -= count;
+		}
+	}
+}
+
+/* Materials */
+/* fills the state of a draw, using the current one if there's no material */
+static void current_draw_state(
+	struct DrawState *state,
+	const struct DrawState *material)
+{
+	if (material != NULL && material->shader != NULL)
+	{
+		*state = *material;
+		return;
+	}
+	memset(state, 0, sizeof(struct DrawState));
+	state->shader = SHADER_CURRENT;
+	state->blend = currentBlend;
+}
+
+static void set_material_key(
+	struct DrawState *key,
+	const struct BLZ_Material *material)
+{
+	int i;
+	memset(key, 0, sizeof(struct DrawState));
+	key->shader = material->shader != NULL ? material->shader : SHADER_DEFAULT;
+	key->blend = material->blend;
+	for (i = 0; i < BLZ_MATERIAL_TEXTURES; i++)
+	{
+		if (material->textures[i] != NULL)
+		{
+			key->textures[i] = material->textures[i]->id;
+		}
+	}
+}
+
+/* sets the shader, blend function and textures of a resolved draw state,
+ * fails if the shader program didn't link, which draws nothing */
+static int apply_draw_state(const struct DrawState *state)
+{
+	int i;
+	if (!finish_shader(state->shader))
+	{
+		return BLZ_FALSE;
+	}
+	if (state->shader->blocks_generation != uniformBlocksGeneration)
+	{
+		bind_uniform_blocks(state->shader);
+	}
+	state_use_program(state->shader->program);
+	state_blend_func(state->blend.source, state->blend.destination);
+	for (i = 0; i < BLZ_MATERIAL_TEXTURES; i++)
+	{
+		if (state->textures[i] != 0)
+		{
+			state_bind_texture(i + 1, state->textures[i]);
+		}
+	}
+	return BLZ_TRUE;
+}
+
+/* the texture slots which materials can change */
+static void save_material_slots(GLuint *slots)
+{
+	memcpy(slots, glState.textures + 1, BLZ_MATERIAL_TEXTURES * sizeof(GLuint));
+}
+
+static void restore_material_slots(const GLuint *slots)
+{
+	int i;
+	for (i = 0; i < BLZ_MATERIAL_TEXTURES; i++)
+	{
+		if (slots[i] != UNKNOWN)
+		{
+			state_bind_texture(i + 1, slots[i]);
+		}
+	}
+}
+
+static int same_material(
+	const struct SpriteBucket *bucket,
+	const struct DrawState *material)
+{
+	if (material == NULL)
+	{
+		return bucket->material.shader == NULL;
+	}
+	return memcmp(&bucket->material, material, sizeof(struct DrawState)) == 0;
+}
+
+/* Moves the buckets of the same material next to each other, keeping the
+ * order of their first use. Returns BLZ_TRUE if the batch has materials. */
+static int group_buckets(struct BLZ_SpriteBatch *batch, int count)
+{
+	struct SpriteBucket moved;
+	int i, j, has_materials = BLZ_FALSE;
+	for (i = 0; i < count; i++)
+	{
+		has_materials |= batch->sprite_buckets[i].material.shader != NULL;
+	}
+	if (!has_materials)
+	{
+		return BLZ_FALSE;
+	}
+	for (i = 1; i < count; i++)
+	{
+		for (j = i - 1; j >= 0; j--)
+		{
+			if (same_material(batch->sprite_buckets + j,
+							  &batch->sprite_buckets[i].material))
+			{
+				break;
+			}
+		}
+		if (j < 0 || j == i - 1)
+		{
+			continue;
+		}
+		moved = batch->sprite_buckets[i];
+		memmove(batch->sprite_buckets + j + 2, batch->sprite_buckets + j + 1,
+				(i - j - 1) * sizeof(struct SpriteBucket));
+		batch->sprite_buckets[j + 1] = moved;
+	}
+	return BLZ_TRUE;
+}
+
+static void upload_channels(
+	const struct BLZ_SpriteBatch *batch,
+	const struct SpriteBucket *bucket,
+	GLuint cbo)
+{
+	state_bind_array_buffer(cbo);
+	glBufferData(GL_ARRAY_BUFFER,
+				 bucket->sprite_count * 4 * batch->channel_stride,
+				 BUCKET_CHANNELS(bucket), GL_STREAM_DRAW);
+}
+
+/* sets the same channel values and depth for every vertex of the sprite */
+static void set_sprite_channels(
+	struct BLZ_SpriteBatch *batch,
+	struct SpriteBucket *bucket,
+	const GLfloat *channels)
+{
+	GLubyte *dest = BUCKET_CHANNELS(bucket) +
+					bucket->sprite_count * 4 * batch->channel_stride;
+	GLfloat value;
+	int i, count = batch->channel_count * 4;
+	int size = batch->channel_count * CHANNEL_SIZE(batch->channel_format);
+	if (channels == NULL)
+	{
+		memset(dest, 0, size);
+	}
+	else if (batch->channel_format == CHANNEL_FLOAT)
+	{
+		memcpy(dest, channels, size);
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+		{
+			value = channels[i] < 0.0f ? 0.0f : (channels[i] > 1.0f ? 1.0f : channels[i]);
+			dest[i] = (GLubyte)(value * 255.0f + 0.5f);
+		}
+	}
+	if (HAS_FLAG(batch, OPAQUE_SPRITES))
+	{
+		value = SPRITE_DEPTH(++batch->depth_sequence,
+							 BATCH_MAX_BUCKETS(batch) * BATCH_MAX_SPRITES(batch));
+		memcpy(dest + size, &value, sizeof(GLfloat));
+	}
+	for (i = 1; i < 4; i++)
+	{
+		memcpy(dest + i * batch->channel_stride, dest, batch->channel_stride);
+	}
+}
+
+/* Render queue */
+enum QueueCommandKind
+{
+	COMMAND_CLEAR = 0,
+	COMMAND_SPRITES,
+	COMMAND_STATIC
+};
+
+struct QueueCommand
+{
+	enum QueueCommandKind kind;
+	/* targets are executed in order of their first use */
+	int target_order;
+	GLuint target;
+	int layer;
+	struct DrawState state;
+	GLuint texture;
+	/* sprite range in the queue buffer or static batch VAO */
+	GLuint vao;
+	GLenum index_type;
+	int first;
+	int count;
+	GLfloat mvp[16];
+	/* color of the clear commands */
+	struct BLZ_Vector4 clear_color;
+};
+
+struct BLZ_RenderQueue
+{
+	int max_commands;
+	int max_sprites;
+	int command_count;
+	int sprite_count;
+	struct Buffer buffer;
+#ifdef BLZ_CONFIG_STATIC
+	struct QueueCommand commands[BLZ_MAX_QUEUE_COMMANDS];
+	int order[BLZ_MAX_QUEUE_COMMANDS];
+	GLsizei counts[BLZ_MAX_QUEUE_COMMANDS];
+	const GLvoid *offsets[BLZ_MAX_QUEUE_COMMANDS];
+	struct BLZ_SpriteQuad quads[BLZ_MAX_QUEUE_SPRITES];
+#else
+	struct QueueCommand *commands;
+	/* command indices in execution order */
+	int *order;
+	/* glMultiDrawElements parameters */
+	GLsizei *counts;
+	const GLvoid **offsets;
+	struct BLZ_SpriteQuad *quads;
+#endif
+};
+
+#ifdef BLZ_CONFIG_STATIC
+STATIC_POOL(queuePool, struct BLZ_RenderQueue, BLZ_MAX_RENDER_QUEUES,
+			MEMORY_BATCHES)
+#endif
+
+static void free_queue_storage(struct BLZ_RenderQueue *queue)
+{
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(queue->commands);
+	blz_free(queue->order);
+	blz_free(queue->counts);
+	blz_free(queue->offsets);
+	blz_free(queue->quads);
+#endif
+	delete_object(queuePool, queue);
+}
+
+struct BLZ_RenderQueue *BLZ_CreateRenderQueue(int max_commands, int max_sprites)
+{
+	struct BLZ_RenderQueue *queue;
+	null_if_invalid(max_commands > 0);
+	null_if_invalid(max_sprites > 0 && max_sprites <= 16384);
+#ifdef BLZ_CONFIG_STATIC
+	null_if_invalid(max_commands <= BLZ_MAX_QUEUE_COMMANDS);
+	null_if_invalid(max_sprites <= BLZ_MAX_QUEUE_SPRITES);
+#endif
+	queue = new_object(queuePool, MEMORY_BATCHES, struct BLZ_RenderQueue);
+	check_alloc(queue);
+	queue->max_commands = max_commands;
+	queue->max_sprites = max_sprites;
+	queue->command_count = 0;
+	queue->sprite_count = 0;
+#ifndef BLZ_CONFIG_STATIC
+	queue->commands = blz_malloc(MEMORY_BATCHES,
+								 max_commands * sizeof(struct QueueCommand));
+	queue->order = blz_malloc(MEMORY_BATCHES, max_commands * sizeof(int));
+	queue->counts = blz_malloc(MEMORY_BATCHES, max_commands * sizeof(GLsizei));
+	queue->offsets = blz_malloc(MEMORY_BATCHES, max_commands * sizeof(GLvoid *));
+	queue->quads = blz_malloc(MEMORY_VERTICES,
+							  max_sprites * sizeof(struct BLZ_SpriteQuad));
+	if (queue->commands == NULL || queue->order == NULL ||
+		queue->counts == NULL || queue->offsets == NULL || queue->quads == NULL)
+	{
+		free_queue_storage(queue);
+		fail("Could not allocate memory");
+	}
+#endif
+	queue->buffer = create_buffer(max_sprites, GL_STREAM_DRAW);
+	return queue;
+}
+
+int BLZ_FreeRenderQueue(struct BLZ_RenderQueue *queue)
+{
+	if (queue == NULL)
+	{
+		success();
+	}
+	if (__activeQueue == queue)
+	{
+		__activeQueue = NULL;
+	}
+	free_buffer(queue->buffer);
+	free_queue_storage(queue);
+	success();
+}
+
+int BLZ_SetLayer(int layer)
+{
+	currentLayer = layer;
+	success();
+}
+
+int BLZ_BeginQueue(struct BLZ_RenderQueue *queue)
+{
+	validate(queue != NULL);
+	if (__activeQueue != NULL)
+	{
+		fail("Another render queue is already active");
+	}
+	flush_immediate();
+	queue->command_count = 0;
+	queue->sprite_count = 0;
+	currentLayer = 0;
+	__activeQueue = queue;
+	success();
+}
+
+static struct QueueCommand *queue_command(enum QueueCommandKind kind)
+{
+	struct BLZ_RenderQueue *queue = __activeQueue;
+	struct QueueCommand *cmd, *prev;
+	int i;
+	if (queue->command_count >= queue->max_commands)
+	{
+		return NULL;
+	}
+	cmd = queue->commands + queue->command_count;
+	prev = queue->command_count > 0 ? cmd - 1 : NULL;
+	cmd->kind = kind;
+	cmd->index_type = GL_UNSIGNED_SHORT;
+	cmd->target = currentTarget;
+	cmd->target_order = queue->command_count;
+	if (prev != NULL && prev->target == currentTarget)
+	{
+		cmd->target_order = prev->target_order;
+	}
+	else
+	{
+		/* the target is switched, look if it was used before */
+		for (i = queue->command_count - 1; i >= 0; i--)
+		{
+			if (queue->commands[i].target == currentTarget)
+			{
+				cmd->target_order = queue->commands[i].target_order;
+				break;
+			}
+		}
+	}
+	cmd->layer = currentLayer;
+	current_draw_state(&cmd->state, NULL);
+	cmd->texture = 0;
+	cmd->vao = 0;
+	cmd->first = 0;
+	cmd->count = 0;
+	queue->command_count++;
+	return cmd;
+}
+
+static int queue_clear()
+{
+	struct QueueCommand *cmd = queue_command(COMMAND_CLEAR);
+	fail_if_null(cmd, "Render queue command limit reached");
+	cmd->clear_color = currentClearColor;
+	success();
+}
+
+static int same_state(
+	const struct QueueCommand *cmd,
+	GLuint texture,
+	const struct DrawState *state)
+{
+	return cmd->kind == COMMAND_SPRITES &&
+		   cmd->target == currentTarget &&
+		   cmd->layer == currentLayer &&
+		   memcmp(&cmd->state, state, sizeof(struct DrawState)) == 0 &&
+		   cmd->texture == texture &&
+		   memcmp(cmd->mvp, orthoMatrix, sizeof(orthoMatrix)) == 0;
+}
+
+/* Reserves space for the sprites in the queue buffer, extending the last
+ * command if it has the same state. The material is NULL if the current
+ * state should be used. */
+static struct BLZ_SpriteQuad *queue_sprites(
+	GLuint texture,
+	int count,
+	const struct DrawState *material)
+{
+	struct BLZ_RenderQueue *queue = __activeQueue;
+	struct QueueCommand *cmd = NULL;
+	struct BLZ_SpriteQuad *result;
+	struct DrawState state;
+	if (queue->sprite_count + count > queue->max_sprites)
+	{
+		return NULL;
+	}
+	current_draw_state(&state, material);
+	if (queue->command_count > 0)
+	{
+		cmd = queue->commands + queue->command_count - 1;
+		if (!same_state(cmd, texture, &state) ||
+			cmd->first + cmd->count != queue->sprite_count)
+		{
+			cmd = NULL;
+		}
+	}
+	if (cmd == NULL)
+	{
+		cmd = queue_command(COMMAND_SPRITES);
+		if (cmd == NULL)
+		{
+			return NULL;
+		}
+		cmd->state = state;
+		cmd->texture = texture;
+		cmd->first = queue->sprite_count;
+		memcpy(cmd->mvp, orthoMatrix, sizeof(orthoMatrix));
+	}
+	cmd->count += count;
+	result = queue->quads + queue->sprite_count;
+	queue->sprite_count += count;
+	return result;
+}
+
+static int queue_batch(struct BLZ_SpriteBatch *batch)
+{
+	struct SpriteBucket *bucket;
+	struct BLZ_SpriteQuad *dest;
+	int i, page, count, remaining;
+	if (batch->channel_stride > 0)
+	{
+		fail("Batches with custom channels or opaque sprites can't be "
+			 "recorded by a render queue");
+	}
+	for (i = 0; i < BATCH_MAX_BUCKETS(batch); i++)
+	{
+		bucket = (batch->sprite_buckets + i);
+		if (bucket->sprite_count == 0 || bucket->texture == 0)
+		{
+			break;
+		}
+		dest = queue_sprites(bucket->texture, bucket->sprite_count,
+							 &bucket->material);
+		fail_if_null(dest, "Render queue limit reached - increase limits in BLZ_CreateRenderQueue(...)");
+		remaining = bucket->sprite_count;
+		for (page = 0; remaining > 0; page++)
+		{
+			count = remaining < (int)SPRITES_PER_PAGE ? remaining : (int)SPRITES_PER_PAGE;
+			memcpy(dest, bucket->pages[page]->quads,
+				   count * sizeof(struct BLZ_SpriteQuad));
+			dest += count;
+			remaining -= count;
+		}
+		release_bucket_pages(batch, bucket);
+		bucket->sprite_count = 0;
+		bucket->texture = 0;
+		bucket->last_used = batch->frame;
+	}
+	success();
+}
+
+/* the batches split into cells or textures are queued as their visible
+ * index ranges */
+static int queue_static(const struct BLZ_StaticBatch *batch, const GLfloat *mvp,
+						int draws)
+{
+	struct QueueCommand *cmd;
+	int i, index_size = INDEX_SIZE(batch->index_type);
+	for (i = 0; i < draws; i++)
+	{
+		cmd = queue_command(COMMAND_STATIC);
+		fail_if_null(cmd, "Render queue command limit reached");
+		cmd->vao = batch->buffer.vao;
+		cmd->index_type = batch->index_type;
+		if (batch->cell_size > 0 || batch->mixed_textures)
+		{
+			cmd->texture = batch->range_textures[i];
+			cmd->first = (int)((size_t)batch->offsets[i] / (6 * index_size));
+			cmd->count = batch->counts[i] / 6;
+		}
+		else
+		{
+			cmd->texture = batch->textures[0];
+			cmd->first = 0;
+			cmd->count = batch->sprite_count;
+		}
+		memcpy(cmd->mvp, mvp, sizeof(cmd->mvp));
+	}
+	success();
+}
+
+#define COMPARE_FIELD(a, b)            \
+	do                                 \
+	{                                  \
+		if ((a) != (b))                \
+		{                              \
+			return (a) < (b) ? -1 : 1; \
+		}                              \
+	} while (0);
+
+static struct BLZ_RenderQueue *__sortedQueue;
+
+static int compare_commands(const void *left, const void *right)
+{
+	const struct QueueCommand *a = __sortedQueue->commands + *(const int *)left;
+	const struct QueueCommand *b = __sortedQueue->commands + *(const int *)right;
+	int i;
+	COMPARE_FIELD(a->target_order, b->target_order);
+	/* clears go before everything drawn into the same target */
+	COMPARE_FIELD(a->kind != COMMAND_CLEAR, b->kind != COMMAND_CLEAR);
+	COMPARE_FIELD(a->layer, b->layer);
+	COMPARE_FIELD((size_t)a->state.shader, (size_t)b->state.shader);
+	COMPARE_FIELD(a->state.blend.source, b->state.blend.source);
+	COMPARE_FIELD(a->state.blend.destination, b->state.blend.destination);
+	for (i = 0; i < BLZ_MATERIAL_TEXTURES; i++)
+	{
+		COMPARE_FIELD(a->state.textures[i], b->state.textures[i]);
+	}
+	COMPARE_FIELD(a->texture, b->texture);
+	/* keep the submission order otherwise */
+	return *(const int *)left - *(const int *)right;
+}
+
+static void execute_queue(struct BLZ_RenderQueue *queue)
+{
+	const struct QueueCommand *cmd, *prev = NULL;
+	GLuint slots[BLZ_MATERIAL_TEXTURES];
+	int i, j, draws;
+	save_material_slots(slots);
+	for (i = 0; i < queue->command_count; i++)
+	{
+		queue->order[i] = i;
+	}
+	__sortedQueue = queue;
+	qsort(queue->order, queue->command_count, sizeof(int), compare_commands);
+	if (queue->sprite_count > 0)
+	{
+		state_bind_array_buffer(queue->buffer.vbo);
+		glBufferData(GL_ARRAY_BUFFER,
+					 queue->sprite_count * sizeof(struct BLZ_SpriteQuad),
+					 queue->quads, GL_STREAM_DRAW);
+	}
+	for (i = 0; i < queue->command_count; i = j)
+	{
+		cmd = queue->commands + queue->order[i];
+		j = i + 1;
+		state_bind_framebuffer(cmd->target);
+		if (cmd->kind == COMMAND_CLEAR)
+		{
+			glClearColor(cmd->clear_color.x, cmd->clear_color.y,
+						 cmd->clear_color.z, cmd->clear_color.w);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			prev = cmd;
+			continue;
+		}
+		if (!apply_draw_state(&cmd->state))
+		{
+			prev = cmd;
+			continue;
+		}
+		bind_tex0(cmd->texture);
+		shader_set_mvp(cmd->state.shader, cmd->mvp, 0);
+		if (cmd->kind == COMMAND_STATIC)
+		{
+			state_bind_vao(cmd->vao);
+			glDrawElements(GL_TRIANGLES, cmd->count * 6, cmd->index_type,
+						   (const GLvoid *)(size_t)(cmd->first * 6 *
+													INDEX_SIZE(cmd->index_type)));
+			prev = cmd;
+			continue;
+		}
+		/* merge the following sprite ranges which use the same state */
+		draws = 0;
+		queue->counts[draws] = cmd->count * 6;
+		queue->offsets[draws++] = (const GLvoid *)(cmd->first * 6 * sizeof(GLushort));
+		for (; j < queue->command_count; j++)
+		{
+			prev = queue->commands + queue->order[j];
+			if (prev->kind != COMMAND_SPRITES || prev->target != cmd->target ||
+				prev->texture != cmd->texture ||
+				memcmp(&prev->state, &cmd->state, sizeof(struct DrawState)) != 0 ||
+				memcmp(prev->mvp, cmd->mvp, sizeof(cmd->mvp)) != 0)
+			{
+				break;
+			}
+			queue->counts[draws] = prev->count * 6;
+			queue->offsets[draws++] = (const GLvoid *)(prev->first * 6 * sizeof(GLushort));
+		}
+		state_bind_vao(queue->buffer.vao);
+		if (draws == 1)
+		{
+			glDrawElements(GL_TRIANGLES, queue->counts[0], GL_UNSIGNED_SHORT,
+						   queue->offsets[0]);
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLES, queue->counts, GL_UNSIGNED_SHORT,
+								queue->offsets, draws);
+		}
+		prev = queue->commands + queue->order[j - 1];
+	}
+	/* restore the state which was set outside of the queue */
+	state_bind_framebuffer(currentTarget);
+	state_use_program(SHADER_CURRENT->program);
+	state_blend_func(currentBlend.source, currentBlend.destination);
+	restore_material_slots(slots);
+	glClearColor(currentClearColor.x, currentClearColor.y,
+				 currentClearColor.z, currentClearColor.w);
+}
+
+int BLZ_EndQueue(struct BLZ_RenderQueue *queue)
+{
+	validate(queue != NULL);
+	if (__activeQueue != queue)
+	{
+		fail("The render queue is not active");
+	}
+	__activeQueue = NULL;
+	execute_queue(queue);
+	queue->command_count = 0;
+	queue->sprite_count = 0;
+	success();
+}
+
+/* Opaque sprites */
+/* the default shader is replaced by its alpha-tested variant */
+static struct BLZ_Shader *opaque_shader()
+{
+	if (SHADER_OPAQUE == NULL)
+	{
+		SHADER_OPAQUE = BLZ_GetDefaultShaderVariant(opaqueDefines);
+	}
+	return SHADER_OPAQUE == NULL ? SHADER_DEFAULT : SHADER_OPAQUE;
+}
+
+static void begin_opaque()
+{
+	struct BLZ_Shader *shader = SHADER_CURRENT;
+	int slice;
+	if (shader == SHADER_DEFAULT)
+	{
+		shader = opaque_shader();
+	}
+	if (shader->blocks_generation != uniformBlocksGeneration)
+	{
+		bind_uniform_blocks(shader);
+	}
+	state_use_program(shader->program);
+	shader_set_mvp(shader, orthoMatrix, orthoGeneration);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	/* the later presents get the closer slices, so they are drawn over the
+	 * earlier ones like the blended sprites, the earlier depths are behind
+	 * all of the new ones when the slices run out */
+	slice = *currentDepthSlice;
+	if (slice >= BLZ_DEPTH_SLICES)
+	{
+		glClear(GL_DEPTH_BUFFER_BIT);
+		slice = 0;
+	}
+	glDepthRange(1.0 - (slice + 1) / (GLdouble)BLZ_DEPTH_SLICES,
+				 1.0 - slice / (GLdouble)BLZ_DEPTH_SLICES);
+	*currentDepthSlice = slice + 1;
+}
+
+static void end_opaque()
+{
+	glDepthRange(0.0, 1.0);
+	glEnable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+}
+
+static int flush(struct BLZ_SpriteBatch *batch)
+{
+	unsigned char to_draw, to_fill;
+	struct SpriteBucket *bucket;
+	struct DrawState state;
+	GLuint slots[BLZ_MATERIAL_TEXTURES];
+	int i, j, count, first, has_materials, is_drawn;
+	if (__activeQueue != NULL)
+	{
+		i = queue_batch(batch);
+		__lastBatch = NULL;
+		__lastBucket = NULL;
+		return i;
+	}
+	set_mvp_matrix((const GLfloat *)&orthoMatrix);
+	for (count = 0; count < BATCH_MAX_BUCKETS(batch); count++)
+	{
+		bucket = batch->sprite_buckets + count;
+		if (bucket->sprite_count == 0 || bucket->texture == 0)
+		{
+			break;
+		}
+	}
+	has_materials = group_buckets(batch, count);
+	if (has_materials)
+	{
+		save_material_slots(slots);
+	}
+	if (HAS_FLAG(batch, OPAQUE_SPRITES))
+	{
+		begin_opaque();
+	}
+	if (HAS_FLAG(batch, NO_BUFFERING) || batch->frameskip)
+	{
+		to_draw = to_fill = 0;
+	}
+	else
+	{
+		to_draw = batch->buffer_index,
+		to_fill = batch->buffer_index + 1;
+		if (to_fill >= BUFFER_COUNT)
+		{
+			to_fill -= BUFFER_COUNT;
+		}
+	}
+	for (j = 0; j < count; j++)
+	{
+		/* the opaque buckets are drawn front-to-back, the later ones are
+		 * mostly closer */
+		i = HAS_FLAG(batch, OPAQUE_SPRITES) ? count - 1 - j : j;
+		bucket = (batch->sprite_buckets + i);
+		is_drawn = BLZ_TRUE;
+		if (has_materials)
+		{
+			current_draw_state(&state, &bucket->material);
+			if (state.shader == SHADER_DEFAULT && HAS_FLAG(batch, OPAQUE_SPRITES))
+			{
+				state.shader = opaque_shader();
+			}
+			/* the sprites are still uploaded to keep the buffers in sync */
+			is_drawn = apply_draw_state(&state);
+			if (is_drawn)
+			{
+				shader_set_mvp(state.shader, orthoMatrix, orthoGeneration);
+			}
+		}
+		/* fill the buffer and give the pages back to the pool */
+		upload_bucket(bucket, bucket->buffer[to_fill].vbo);
+		release_bucket_pages(batch, bucket);
+		if (batch->channel_stride > 0)
+		{
+			upload_channels(batch, bucket, bucket->buffer[to_fill].cbo);
+		}
+		/* bind our texture and the VAO and draw it */
+		bind_tex0(bucket->texture);
+		/* newly materialized bucket has nothing to draw from the other buffer */
+		state_bind_vao(bucket->buffer[bucket->is_fresh ? to_fill : to_draw].vao);
+		first = HAS_FLAG(batch, OPAQUE_SPRITES)
+					? BATCH_MAX_SPRITES(batch) - bucket->sprite_count
+					: 0;
+		if (is_drawn)
+		{
+			glDrawElements(GL_TRIANGLES, bucket->sprite_count * 6,
+						   GL_UNSIGNED_SHORT, (void *)(first * 6 * sizeof(GLushort)));
+		}
+		bucket->sprite_count = 0;
+		bucket->texture = 0;
+		bucket->is_fresh = BLZ_FALSE;
+		bucket->last_used = batch->frame;
+	}
+	if (has_materials || HAS_FLAG(batch, OPAQUE_SPRITES))
+	{
+		state_use_program(SHADER_CURRENT->program);
+	}
+	if (has_materials)
+	{
+		state_blend_func(currentBlend.source, currentBlend.destination);
+		restore_material_slots(slots);
+	}
+	if (HAS_FLAG(batch, OPAQUE_SPRITES))
+	{
+		end_opaque();
+		batch->depth_sequence = 0;
+	}
+	__lastBatch = NULL;
+	__lastBucket = NULL;
+	success();
+}
+
+int BLZ_Present(struct BLZ_SpriteBatch *batch)
+{
+	flush_immediate();
+	fail_if_false(flush(batch), "Could not flush the sprite batch");
+	if (__activeQueue != NULL)
+	{
+		/* the sprites were copied to the queue, the buffers of the batch
+		 * were not used */
+		success();
+	}
+	if (!HAS_FLAG(batch, NO_BUFFERING) && batch->frameskip == 0)
+	{
+		batch->buffer_index++;
+		if (batch->buffer_index >= BUFFER_COUNT)
+		{
+			batch->buffer_index -= BUFFER_COUNT;
+		}
+	}
+	if (batch->frameskip > 0)
+	{
+		batch->frameskip--;
+	}
+	batch->frame++;
+	success();
+}
+
+#define swap(tmp, one, two) \
+	do                      \
+	{                       \
+		tmp = one;          \
+		one = two;          \
+		two = tmp;          \
+	} while (0);
+
+static inline void set_quad_positions(
+	struct BLZ_SpriteQuad *quad,
+	GLfloat x, GLfloat y,
+	GLfloat dx, GLfloat dy,
+	GLfloat w, GLfloat h)
+{
+	quad->vertices[0].x = x + dx;
+	quad->vertices[0].y = y + dy;
+	quad->vertices[2].x = x + (dx + w);
+	quad->vertices[2].y = y + dy;
+	quad->vertices[3].x = x + (dx + w);
+	quad->vertices[3].y = y + (dy + h);
+	quad->vertices[1].x = x + dx;
+	quad->vertices[1].y = y + (dy + h);
+}
+
+static inline void set_quad_positions_rotated(
+	struct BLZ_SpriteQuad *quad,
+	GLfloat x, GLfloat y,
+	GLfloat dx, GLfloat dy,
+	GLfloat w, GLfloat h,
+	GLfloat _sin, GLfloat _cos)
+{
+	quad->vertices[0].x = x + dx * _cos - dy * _sin;
+	quad->vertices[0].y = y + dx * _sin + dy * _cos;
+	quad->vertices[2].x = x + (dx + w) * _cos - dy * _sin;
+	quad->vertices[2].y = y + (dx + w) * _sin + dy * _cos;
+	quad->vertices[3].x = x + (dx + w) * _cos - (dy + h) * _sin;
+	quad->vertices[3].y = y + (dx + w) * _sin + (dy + h) * _cos;
+	quad->vertices[1].x = x + dx * _cos - (dy + h) * _sin;
+	quad->vertices[1].y = y + dx * _sin + (dy + h) * _cos;
+}
+
+static inline void set_quad_texcoords(
+	struct BLZ_SpriteQuad *quad,
+	GLfloat u1, GLfloat v1,
+	GLfloat u2, GLfloat v2)
+{
+	quad->vertices[0].u = u1;
+	quad->vertices[0].v = v1;
+	quad->vertices[2].u = u2;
+	quad->vertices[2].v = v1;
+	quad->vertices[3].u = u2;
+	quad->vertices[3].v = v2;
+	quad->vertices[1].u = u1;
+	quad->vertices[1].v = v2;
+}
+
+static inline void set_quad_color(
+	struct BLZ_SpriteQuad *quad,
+	const struct BLZ_Vector4 color)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+	{
+		quad->vertices[i].r = color.x;
+		quad->vertices[i].g = color.y;
+		quad->vertices[i].b = color.z;
+		quad->vertices[i].a = color.w;
+	}
+}
+
+/* Transform specializations.
+ * Every combination of optional transform parameters gets its own function
+ * generated from transform_generic, so the compiler can drop the unused
+ * branches. The mask is calculated once per sprite in transform(). */
+#define T_SRC 1
+#define T_ROTATION 2
+#define T_ORIGIN 4
+#define T_SCALE 8
+#define T_FLIP 16
+#define T_ALL (T_SRC | T_ROTATION | T_ORIGIN | T_SCALE | T_FLIP)
+
+#define TRANSFORM_PARAMS                       \
+	const struct BLZ_Texture *texture,         \
+	const struct BLZ_Vector2 position,         \
+	const struct BLZ_Rectangle *srcRectangle,  \
+	float rotation,                            \
+	const struct BLZ_Vector2 *origin,          \
+	const struct BLZ_Vector2 *scale,           \
+	const struct BLZ_Vector4 color,            \
+	enum BLZ_SpriteFlip effects
+#define TRANSFORM_ARGS texture, position, srcRectangle, rotation, \
+					   origin, scale, color, effects
+
+static inline struct BLZ_SpriteQuad transform_generic(
+	const int mask, TRANSFORM_PARAMS)
+{
+	struct BLZ_SpriteQuad quad;
+	GLfloat x = position.x;
+	GLfloat y = position.y;
+	GLfloat tw = (GLfloat)texture->width;
+	GLfloat th = (GLfloat)texture->height;
+	GLfloat w = tw, h = th;
+	GLfloat u1 = 0, v1 = 0, u2 = 1, v2 = 1;
+	GLfloat dx = 0, dy = 0;
+	GLfloat tmp;
+	if (mask & T_SRC)
+	{
+		/* sprite sizes are whole pixels */
+		w = (GLfloat)(int)srcRectangle->w;
+		h = (GLfloat)(int)srcRectangle->h;
+		u1 = srcRectangle->x / tw;
+		v1 = srcRectangle->y / th;
+		u2 = u1 + (srcRectangle->w / tw);
+		v2 = v1 + (srcRectangle->h / th);
+	}
+	if (mask & T_SCALE)
+	{
+		w = (GLfloat)(int)(w * scale->x);
+		h = (GLfloat)(int)(h * scale->y);
+	}
+	if (mask & T_ORIGIN)
+	{
+		dx = -origin->x;
+		dy = -origin->y;
+	}
+	if (mask & T_ROTATION)
+	{
+		set_quad_positions_rotated(&quad, x, y, dx, dy, w, h,
+								   sin(rotation), cos(rotation));
+	}
+	else
+	{
+		set_quad_positions(&quad, x, y, dx, dy, w, h);
+	}
+	if (mask & T_FLIP)
+	{
+		if (effects & FLIP_H)
+		{
+			swap(tmp, u1, u2);
+		}
+		if (effects & FLIP_V)
+		{
+			swap(tmp, v1, v2);
+		}
+	}
+	set_quad_texcoords(&quad, u1, v1, u2, v2);
+	set_quad_color(&quad, color);
+	return quad;
+}
+
+typedef struct BLZ_SpriteQuad (*transform_func)(TRANSFORM_PARAMS);
+
+#define TRANSFORM_SPECIALIZATION(mask)                                 \
+	static struct BLZ_SpriteQuad transform_##mask(TRANSFORM_PARAMS)    \
+	{                                                                  \
+		return transform_generic(mask, TRANSFORM_ARGS);                \
+	}
+#define TRANSFORM_SPECIALIZATION_8(n)     \
+	TRANSFORM_SPECIALIZATION(n##0)        \
+	TRANSFORM_SPECIALIZATION(n##1)        \
+	TRANSFORM_SPECIALIZATION(n##2)        \
+	TRANSFORM_SPECIALIZATION(n##3)        \
+	TRANSFORM_SPECIALIZATION(n##4)        \
+	TRANSFORM_SPECIALIZATION(n##5)        \
+	TRANSFORM_SPECIALIZATION(n##6)        \
+	TRANSFORM_SPECIALIZATION(n##7)
+/* octal literals, 000-037 */
+TRANSFORM_SPECIALIZATION_8(00)
+TRANSFORM_SPECIALIZATION_8(01)
+TRANSFORM_SPECIALIZATION_8(02)
+TRANSFORM_SPECIALIZATION_8(03)
+
+#define TRANSFORM_ENTRIES_8(n) \
+	transform_##n##0, transform_##n##1, transform_##n##2, transform_##n##3, \
+	transform_##n##4, transform_##n##5, transform_##n##6, transform_##n##7
+static const transform_func TRANSFORMS[T_ALL + 1] = {
+	TRANSFORM_ENTRIES_8(00),
+	TRANSFORM_ENTRIES_8(01),
+	TRANSFORM_ENTRIES_8(02),
+	TRANSFORM_ENTRIES_8(03)};
+
+#ifdef BENCHMARK
+/* Full transform path which accepts any parameter combination, used as
+ * the baseline for benchmarks */
+static struct BLZ_SpriteQuad transform_full(TRANSFORM_PARAMS)
+{
+	struct BLZ_SpriteQuad quad;
+	GLfloat dx, dy;
+	GLfloat x = position.x;
+	GLfloat y = position.y;
+	GLfloat tw = (GLfloat)texture->width;
+	GLfloat th = (GLfloat)texture->height;
+	int w = srcRectangle == NULL ? tw : srcRectangle->w;
+	int h = srcRectangle == NULL ? th : srcRectangle->h;
+	GLfloat _sin = rotation == 0.0f ? 0.0f : sin(rotation);
+	GLfloat _cos = rotation == 0.0f ? 1.0f : cos(rotation);
+	GLfloat u1 = srcRectangle == NULL ? 0 : srcRectangle->x / tw;
+	GLfloat v1 = srcRectangle == NULL ? 0 : srcRectangle->y / th;
+	GLfloat u2 = srcRectangle == NULL ? 1 : u1 + (srcRectangle->w / tw);
+	GLfloat v2 = srcRectangle == NULL ? 1 : v1 + (srcRectangle->h / th);
+	GLfloat tmp;
+	if (scale != NULL)
+	{
+		w *= scale->x;
+		h *= scale->y;
+	}
+	if (origin == NULL)
+	{
+		dx = 0;
+		dy = 0;
+	}
+	else
+	{
+		dx = -origin->x;
+		dy = -origin->y;
+	}
+	set_quad_positions_rotated(&quad, x, y, dx, dy, w, h, _sin, _cos);
+
+	/* calculate texture coordinates */
+	switch (effects)
+	{
+	case FLIP_H:
+		swap(tmp, u1, u2);
+		break;
+	case FLIP_V:
+		swap(tmp, v1, v2);
+		break;
+	case BOTH:
+		swap(tmp, u1, u2);
+		swap(tmp, v1, v2);
+		break;
+	default:
+		break;
+	}
+	set_quad_texcoords(&quad, u1, v1, u2, v2);
+	set_quad_color(&quad, color);
+	return quad;
+}
+#endif
+
+#ifdef BENCHMARK
+/* allows the benchmarks to compare the specializations with the full path */
+int BLZ_BenchForceFullTransform = 0;
+#endif
+
+static inline int transform_mask(
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	enum BLZ_SpriteFlip effects)
+{
+	return (srcRectangle != NULL ? T_SRC : 0) |
+		   (rotation != 0.0f ? T_ROTATION : 0) |
+		   (origin != NULL ? T_ORIGIN : 0) |
+		   (scale != NULL ? T_SCALE : 0) |
+		   (effects != NONE ? T_FLIP : 0);
+}
+
+/* the source rectangle of the trimmed texture is given in the coordinates of
+ * the source image, it's cut to the trimmed part and the removed padding is
+ * added to the origin */
+static struct BLZ_SpriteQuad transform_trimmed(TRANSFORM_PARAMS)
+{
+	struct BLZ_Rectangle part;
+	struct BLZ_Vector2 offset;
+	GLfloat x1, y1, x2, y2;
+	GLfloat sx = scale == NULL ? 1 : scale->x;
+	GLfloat sy = scale == NULL ? 1 : scale->y;
+	GLfloat src_x = srcRectangle == NULL ? 0 : srcRectangle->x;
+	GLfloat src_y = srcRectangle == NULL ? 0 : srcRectangle->y;
+	GLfloat src_w = srcRectangle == NULL ? texture->source_width
+										 : srcRectangle->w;
+	GLfloat src_h = srcRectangle == NULL ? texture->source_height
+										 : srcRectangle->h;
+	x1 = fmax(src_x, texture->trim_x);
+	y1 = fmax(src_y, texture->trim_y);
+	x2 = fmin(src_x + src_w, texture->trim_x + texture->width);
+	y2 = fmin(src_y + src_h, texture->trim_y + texture->height);
+	/* the rectangle may contain only the padding */
+	x2 = fmax(x1, x2);
+	y2 = fmax(y1, y2);
+	part.x = x1 - texture->trim_x;
+	part.y = y1 - texture->trim_y;
+	part.w = x2 - x1;
+	part.h = y2 - y1;
+	offset.x = (effects & FLIP_H) ? src_x + src_w - x2 : x1 - src_x;
+	offset.y = (effects & FLIP_V) ? src_y + src_h - y2 : y1 - src_y;
+	offset.x = (origin == NULL ? 0 : origin->x) - offset.x * sx;
+	offset.y = (origin == NULL ? 0 : origin->y) - offset.y * sy;
+	return TRANSFORMS[transform_mask(&part, rotation, &offset, scale, effects)](
+		texture, position, &part, rotation, &offset, scale, color, effects);
+}
+
+inline static struct BLZ_SpriteQuad transform(TRANSFORM_PARAMS)
+{
+	int mask = transform_mask(srcRectangle, rotation, origin, scale, effects);
+#ifdef BENCHMARK
+	if (BLZ_BenchForceFullTransform)
+	{
+		return transform_full(TRANSFORM_ARGS);
+	}
+#endif
+	/* the textures filled by the caller have no source size */
+	if (texture->source_width > 0 &&
+		(texture->width != texture->source_width ||
+		 texture->height != texture->source_height))
+	{
+		return transform_trimmed(TRANSFORM_ARGS);
+	}
+	return TRANSFORMS[mask](TRANSFORM_ARGS);
+}
+
+/* Sprite definitions */
+int BLZ_InitSpriteDef(
+	struct BLZ_SpriteDef *def,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Rectangle *srcRectangle,
+	const struct BLZ_Vector2 *origin)
+{
+	GLfloat tw, th, u1, v1, u2, v2;
+	int i;
+	validate(def != NULL);
+	validate(texture != NULL);
+	tw = (GLfloat)texture->width;
+	th = (GLfloat)texture->height;
+	u1 = srcRectangle == NULL ? 0 : srcRectangle->x / tw;
+	v1 = srcRectangle == NULL ? 0 : srcRectangle->y / th;
+	u2 = srcRectangle == NULL ? 1 : u1 + (srcRectangle->w / tw);
+	v2 = srcRectangle == NULL ? 1 : v1 + (srcRectangle->h / th);
+	def->texture = texture;
+	/* sizes are whole pixels, same as in transform_full */
+	def->size.x = (GLfloat)(int)(srcRectangle == NULL ? tw : srcRectangle->w);
+	def->size.y = (GLfloat)(int)(srcRectangle == NULL ? th : srcRectangle->h);
+	def->origin.x = origin == NULL ? 0 : origin->x;
+	def->origin.y = origin == NULL ? 0 : origin->y;
+	for (i = NONE; i <= BOTH; i++)
+	{
+		def->uv[i].x = (i & FLIP_H) ? u2 : u1;
+		def->uv[i].y = (i & FLIP_V) ? v2 : v1;
+		def->uv[i].z = (i & FLIP_H) ? u1 : u2;
+		def->uv[i].w = (i & FLIP_V) ? v1 : v2;
+	}
+	success();
+}
+
+static struct BLZ_SpriteQuad transform_def(
+	const struct BLZ_SpriteDef *def,
+	const struct BLZ_Vector2 position,
+	float rotation,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad;
+	const struct BLZ_Vector4 uv = def->uv[effects & BOTH];
+	GLfloat x = position.x;
+	GLfloat y = position.y;
+	GLfloat w = def->size.x;
+	GLfloat h = def->size.y;
+	GLfloat dx = -def->origin.x;
+	GLfloat dy = -def->origin.y;
+	if (scale != NULL)
+	{
+		w = (GLfloat)(int)(w * scale->x);
+		h = (GLfloat)(int)(h * scale->y);
+	}
+	if (rotation == 0.0f)
+	{
+		set_quad_positions(&quad, x, y, dx, dy, w, h);
+	}
+	else
+	{
+		set_quad_positions_rotated(&quad, x, y, dx, dy, w, h,
+								   sin(rotation), cos(rotation));
+	}
+	set_quad_texcoords(&quad, uv.x, uv.y, uv.z, uv.w);
+	set_quad_color(&quad, color);
+	return quad;
+}
+
+int BLZ_DrawDef(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_SpriteDef *def,
+	const struct BLZ_Vector2 position,
+	float rotation,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform_def(
+		def,
+		position,
+		rotation,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDraw(batch, def->texture->id, &quad);
+}
+
+int BLZ_Draw(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform(
+		texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDraw(batch, texture->id, &quad);
+}
+
+/* material is NULL for the sprites drawn using the current state */
+static int lower_draw(
+	struct BLZ_SpriteBatch *batch,
+	GLuint texture,
+	const struct DrawState *material,
+	const struct BLZ_SpriteQuad *quad,
+	const GLfloat *channels)
+{
+	struct SpriteBucket *bucket = NULL;
+	int i = 0, page;
+	if (__lastBatch != batch)
+	{
+		__lastBatch = NULL;
+		__lastBucket = NULL;
+	}
+	if (texture > 0 && __lastBucket != NULL &&
+		__lastBucket->texture == texture &&
+		__lastBucket->sprite_count < BATCH_MAX_SPRITES(batch) &&
+		same_material(__lastBucket, material))
+	{
+		bucket = __lastBucket;
+	}
+	if (bucket == NULL)
+	{
+		for (i = 0; i < BATCH_MAX_BUCKETS(batch); i++)
+		{
+			bucket = (batch->sprite_buckets + i);
+			if (bucket->texture == 0)
+			{
+				/* we found an empty bucket */
+				break;
+			}
+			if (bucket->texture == texture && same_material(bucket, material) &&
+				bucket->sprite_count < BATCH_MAX_SPRITES(batch))
+			{
+				/* we found existing not-full bucket */
+				break;
+			}
+		}
+	}
+	if (bucket->sprite_count >= BATCH_MAX_SPRITES(batch) ||
+		(bucket->texture != 0 &&
+		 (bucket->texture != texture || !same_material(bucket, material))))
+	{
+		/* we ran out of limits */
+		fail("Sprite limit reached - increase limits in BLZ_CreateBatch(...)");
+	}
+	if (!bucket->is_materialized)
+	{
+		fail_if_false(materialize_bucket(batch, bucket),
+					  "Could not allocate sprite bucket");
+	}
+	page = bucket->sprite_count / SPRITES_PER_PAGE;
+	if (bucket->pages[page] == NULL)
+	{
+		bucket->pages[page] = acquire_page();
+		check_alloc(bucket->pages[page]);
+	}
+	/* set the vertex data */
+	memcpy(bucket->pages[page]->quads + bucket->sprite_count % SPRITES_PER_PAGE,
+		   quad, sizeof(struct BLZ_SpriteQuad));
+	if (batch->channel_stride > 0)
+	{
+		set_sprite_channels(batch, bucket, channels);
+	}
+	if (bucket->sprite_count == 0)
+	{
+		if (material != NULL)
+		{
+			bucket->material = *material;
+		}
+		else
+		{
+			memset(&bucket->material, 0, sizeof(struct DrawState));
+		}
+	}
+	bucket->sprite_count++;
+	bucket->texture = texture;
+	__lastBatch = batch;
+	__lastBucket = bucket;
+	success();
 }
 
 int BLZ_LowerDraw(
 	struct BLZ_SpriteBatch *batch,
 	GLuint texture, const struct BLZ_SpriteQuad *quad)
 {
-	struct SpriteBucket *bucket = NULL;
-	int i = 0;
-	size_t offset;
-	if (__lastBatch != batch)
+	return lower_draw(batch, texture, NULL, quad, NULL);
+}
+
+int BLZ_InitMaterial(
+	struct BLZ_Material *material,
+	struct BLZ_Shader *shader,
+	const struct BLZ_BlendFunc blend)
+{
+	int i;
+	validate(material != NULL);
+	material->shader = shader;
+	material->blend = blend;
+	for (i = 0; i < BLZ_MATERIAL_TEXTURES; i++)
+	{
+		material->textures[i] = NULL;
+	}
+	success();
+}
+
+int BLZ_LowerDrawMaterial(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Material *material,
+	GLuint texture,
+	const struct BLZ_SpriteQuad *quad)
+{
+	return BLZ_LowerDrawEx(batch, material, texture, quad, NULL);
+}
+
+int BLZ_LowerDrawEx(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Material *material,
+	GLuint texture,
+	const struct BLZ_SpriteQuad *quad,
+	const GLfloat *channels)
+{
+	struct DrawState key;
+	if (material == NULL)
+	{
+		return lower_draw(batch, texture, NULL, quad, channels);
+	}
+	set_material_key(&key, material);
+	return lower_draw(batch, texture, &key, quad, channels);
+}
+
+int BLZ_DrawEx(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Material *material,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects,
+	const GLfloat *channels)
+{
+	struct BLZ_SpriteQuad quad = transform(
+		texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawEx(batch, material, texture->id, &quad, channels);
+}
+
+int BLZ_DrawMaterial(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Material *material,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform(
+		texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawMaterial(batch, material, texture->id, &quad);
+}
+
+int BLZ_DrawDefMaterial(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Material *material,
+	const struct BLZ_SpriteDef *def,
+	const struct BLZ_Vector2 position,
+	float rotation,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform_def(
+		def,
+		position,
+		rotation,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawMaterial(batch, material, def->texture->id, &quad);
+}
+
+/* Sprite meshes */
+/* a texel is covered by the half-planes of 8 directions, a subset of the
+ * diagonal ones is chosen to fit the requested vertex count */
+#define DIAGONAL_PLANES 4
+#define MESH_EPSILON 1e-4f
+
+/* keeps the part of the convex polygon where a * x + b * y <= c */
+static int clip_polygon(struct BLZ_Vector2 *points, int count,
+						GLfloat a, GLfloat b, GLfloat c)
+{
+	struct BLZ_Vector2 result[BLZ_MESH_MAX_VERTICES + 1], cur, next;
+	GLfloat d1, d2, t;
+	int i, clipped = 0;
+	for (i = 0; i < count; i++)
+	{
+		cur = points[i];
+		next = points[(i + 1) % count];
+		d1 = a * cur.x + b * cur.y - c;
+		d2 = a * next.x + b * next.y - c;
+		if (d1 <= 0)
+		{
+			result[clipped++] = cur;
+		}
+		if ((d1 < 0 && d2 > 0) || (d1 > 0 && d2 < 0))
+		{
+			t = d1 / (d1 - d2);
+			result[clipped].x = cur.x + t * (next.x - cur.x);
+			result[clipped].y = cur.y + t * (next.y - cur.y);
+			clipped++;
+		}
+	}
+	/* drop the duplicates which the planes touching a corner produce */
+	count = 0;
+	for (i = 0; i < clipped; i++)
+	{
+		next = result[(i + 1) % clipped];
+		if (fabs(result[i].x - next.x) > MESH_EPSILON ||
+			fabs(result[i].y - next.y) > MESH_EPSILON)
+		{
+			points[count++] = result[i];
+		}
+	}
+	return count;
+}
+
+static GLfloat polygon_area(const struct BLZ_Vector2 *points, int count)
+{
+	GLfloat area = 0;
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		area += points[i].x * points[(i + 1) % count].y -
+				points[(i + 1) % count].x * points[i].y;
+	}
+	return (GLfloat)fabs(area) / 2;
+}
+
+int BLZ_BuildSpriteMesh(
+	struct BLZ_SpriteMesh *mesh,
+	const unsigned char *pixels,
+	int width,
+	int height,
+	const struct BLZ_Rectangle *region,
+	int max_vertices,
+	unsigned char alpha_threshold)
+{
+	/* min and max of x, y, x + y and x - y over the covered texel corners */
+	GLfloat limits[8], planes[DIAGONAL_PLANES][3], area, best_area = -1;
+	struct BLZ_Vector2 points[BLZ_MESH_MAX_VERTICES];
+	int x, y, rx, ry, rw, rh, subset, i, count;
+	validate(mesh != NULL);
+	validate(pixels != NULL);
+	validate(max_vertices >= 4 && max_vertices <= BLZ_MESH_MAX_VERTICES);
+	rx = region == NULL ? 0 : region->x;
+	ry = region == NULL ? 0 : region->y;
+	rw = region == NULL ? width : region->w;
+	rh = region == NULL ? height : region->h;
+	validate(rx >= 0 && ry >= 0 && rw > 0 && rh > 0);
+	validate(rx + rw <= width && ry + rh <= height);
+	mesh->vertex_count = 0;
+	for (y = 0; y < rh; y++)
+	{
+		for (x = 0; x < rw; x++)
+		{
+			if (pixels[((ry + y) * width + rx + x) * 4 + 3] <= alpha_threshold)
+			{
+				continue;
+			}
+			if (mesh->vertex_count == 0)
+			{
+				limits[0] = x, limits[1] = x + 1;
+				limits[2] = y, limits[3] = y + 1;
+				limits[4] = x + y, limits[5] = x + y + 2;
+				limits[6] = x - y - 1, limits[7] = x - y + 1;
+				mesh->vertex_count = 1;
+				continue;
+			}
+			limits[0] = x < limits[0] ? x : limits[0];
+			limits[1] = x + 1 > limits[1] ? x + 1 : limits[1];
+			limits[2] = y < limits[2] ? y : limits[2];
+			limits[3] = y + 1 > limits[3] ? y + 1 : limits[3];
+			limits[4] = x + y < limits[4] ? x + y : limits[4];
+			limits[5] = x + y + 2 > limits[5] ? x + y + 2 : limits[5];
+			limits[6] = x - y - 1 < limits[6] ? x - y - 1 : limits[6];
+			limits[7] = x - y + 1 > limits[7] ? x - y + 1 : limits[7];
+		}
+	}
+	if (mesh->vertex_count == 0)
+	{
+		/* fully transparent, nothing to draw */
+		success();
+	}
+	/* a * x + b * y <= c */
+	planes[0][0] = -1, planes[0][1] = -1, planes[0][2] = -limits[4];
+	planes[1][0] = 1, planes[1][1] = 1, planes[1][2] = limits[5];
+	planes[2][0] = -1, planes[2][1] = 1, planes[2][2] = -limits[6];
+	planes[3][0] = 1, planes[3][1] = -1, planes[3][2] = limits[7];
+	/* the bounding box alone always fits, pick the smallest polygon */
+	for (subset = 0; subset < (1 << DIAGONAL_PLANES); subset++)
+	{
+		points[0].x = limits[0], points[0].y = limits[2];
+		points[1].x = limits[1], points[1].y = limits[2];
+		points[2].x = limits[1], points[2].y = limits[3];
+		points[3].x = limits[0], points[3].y = limits[3];
+		count = 4;
+		for (i = 0; i < DIAGONAL_PLANES; i++)
+		{
+			if (subset & (1 << i))
+			{
+				count = clip_polygon(points, count, planes[i][0],
+									 planes[i][1], planes[i][2]);
+			}
+		}
+		area = polygon_area(points, count);
+		if (count > max_vertices || (best_area >= 0 && area >= best_area))
+		{
+			continue;
+		}
+		best_area = area;
+		mesh->vertex_count = count;
+		for (i = 0; i < count; i++)
+		{
+			mesh->vertices[i].x = points[i].x / rw;
+			mesh->vertices[i].y = points[i].y / rh;
+		}
+	}
+	success();
+}
+
+int BLZ_BuildTextureMesh(
+	struct BLZ_SpriteMesh *mesh,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Rectangle *region,
+	int max_vertices,
+	unsigned char alpha_threshold)
+{
+#ifdef BLZ_CONFIG_STATIC
+	fail("Texture read back is not available in static configuration");
+#else
+	int result;
+	GLint width, height, alignment;
+	GLuint previous;
+	unsigned char *pixels;
+	validate(texture != NULL);
+	/* the trimmed textures may be resized, so the sizes are queried */
+	previous = state_bind_texture_any(texture->id);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+	pixels = blz_malloc(MEMORY_TEMPORARY, (size_t)width * height * 4);
+	if (pixels == NULL)
+	{
+		state_restore_texture_any(previous);
+		fail("Could not allocate memory");
+	}
+	/* the pack state of the caller is kept */
+	glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	state_restore_texture_any(previous);
+	result = BLZ_BuildSpriteMesh(mesh, pixels, width, height,
+								 region, max_vertices, alpha_threshold);
+	blz_free(pixels);
+	return result;
+#endif
+}
+
+/* maps the point of the source rectangle to the transformed quad, which is
+ * a parallelogram */
+static void mesh_vertex(
+	struct BLZ_Vertex *vertex,
+	const struct BLZ_SpriteQuad *quad,
+	struct BLZ_Vector2 point)
+{
+	const struct BLZ_Vertex *tl = quad->vertices;
+	const struct BLZ_Vertex *bl = quad->vertices + 1;
+	const struct BLZ_Vertex *tr = quad->vertices + 2;
+	/* the flipped quad has swapped texture coordinates */
+	GLfloat s = tl->u > tr->u ? 1 - point.x : point.x;
+	GLfloat t = tl->v > bl->v ? 1 - point.y : point.y;
+	*vertex = *tl;
+	vertex->x = tl->x + s * (tr->x - tl->x) + t * (bl->x - tl->x);
+	vertex->y = tl->y + s * (tr->y - tl->y) + t * (bl->y - tl->y);
+	vertex->u = tl->u + s * (tr->u - tl->u) + t * (bl->u - tl->u);
+	vertex->v = tl->v + s * (tr->v - tl->v) + t * (bl->v - tl->v);
+}
+
+int BLZ_LowerDrawMesh(
+	struct BLZ_SpriteBatch *batch,
+	GLuint texture,
+	const struct BLZ_SpriteMesh *mesh,
+	const struct BLZ_SpriteQuad *quad)
+{
+	struct BLZ_SpriteQuad part;
+	int i, last;
+	validate(mesh != NULL);
+	validate(mesh->vertex_count <= BLZ_MESH_MAX_VERTICES);
+	last = mesh->vertex_count - 1;
+	/* the polygon is split into quads sharing the first vertex, the index
+	 * order (0, 1, 2), (2, 1, 3) needs the vertices crosswise */
+	for (i = 1; i < last; i += 2)
+	{
+		mesh_vertex(part.vertices + 0, quad, mesh->vertices[0]);
+		mesh_vertex(part.vertices + 1, quad, mesh->vertices[i]);
+		mesh_vertex(part.vertices + 3, quad, mesh->vertices[i + 1]);
+		mesh_vertex(part.vertices + 2, quad,
+					mesh->vertices[i + 2 <= last ? i + 2 : last]);
+		if (!lower_draw(batch, texture, NULL, &part, NULL))
+		{
+			return BLZ_FALSE;
+		}
+	}
+	success();
+}
+
+int BLZ_DrawMesh(
+	struct BLZ_SpriteBatch *batch,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_SpriteMesh *mesh,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform(
+		texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawMesh(batch, texture->id, mesh, &quad);
+}
+
+/* Static drawing */
+static int compare_cell_keys(const void *left, const void *right)
+{
+	const struct CellKey *a = (const struct CellKey *)left;
+	const struct CellKey *b = (const struct CellKey *)right;
+	/* the textures are drawn in order of their first use */
+	COMPARE_FIELD(a->order, b->order);
+	COMPARE_FIELD(a->y, b->y);
+	COMPARE_FIELD(a->x, b->x);
+	/* keeps the drawing order inside of the cell */
+	COMPARE_FIELD(a->index, b->index);
+	return 0;
+}
+
+static int compare_key_textures(const void *left, const void *right)
+{
+	const struct CellKey *a = (const struct CellKey *)left;
+	const struct CellKey *b = (const struct CellKey *)right;
+	COMPARE_FIELD(a->texture, b->texture);
+	COMPARE_FIELD(a->index, b->index);
+	return 0;
+}
+
+static int is_new_cell(const struct CellKey *keys, int i)
+{
+	return i == 0 || keys[i].order != keys[i - 1].order ||
+		   keys[i].x != keys[i - 1].x || keys[i].y != keys[i - 1].y;
+}
+
+/* makes room for the specified count of cells, the existing ones are kept */
+static int alloc_static_cells(struct BLZ_StaticBatch *batch, int cell_count)
+{
+#ifdef BLZ_CONFIG_STATIC
+	if (cell_count > BLZ_MAX_STATIC_CELLS)
 	{
-		__lastBatch = NULL;
-		__lastBucket = NULL;
-		__lastTexture = 0;
+		fail("Cell limit reached - increase BLZ_MAX_STATIC_CELLS or cell size");
+	}
+	batch->cell_capacity = BLZ_MAX_STATIC_CELLS;
+#else
+	struct StaticCell *cells;
+	char *memory;
+	int capacity = batch->cell_capacity * 2;
+	if (cell_count <= batch->cell_capacity)
+	{
+		success();
+	}
+	capacity = capacity > cell_count ? capacity : cell_count;
+	/* the arrays share a single allocation */
+	memory = blz_malloc(MEMORY_BATCHES,
+							  capacity * (sizeof(struct StaticCell) +
+										  sizeof(GLvoid *) + sizeof(GLsizei) +
+										  sizeof(GLuint)));
+	check_alloc(memory);
+	cells = (struct StaticCell *)((const GLvoid **)memory + capacity);
+	if (batch->cell_count > 0)
+	{
+		memcpy(cells, batch->cells, batch->cell_count * sizeof(struct StaticCell));
+	}
+	blz_free(batch->offsets);
+	batch->offsets = (const GLvoid **)memory;
+	batch->cells = cells;
+	batch->counts = (GLsizei *)(batch->cells + capacity);
+	batch->range_textures = (GLuint *)(batch->counts + capacity);
+	batch->cell_capacity = capacity;
+#endif
+	success();
+}
+
+static void grow_cell(struct StaticCell *cell, const struct BLZ_Vertex *quad)
+{
+	int i;
+	for (i = 0; i < 4; i++)
+	{
+		cell->min_x = quad[i].x < cell->min_x ? quad[i].x : cell->min_x;
+		cell->min_y = quad[i].y < cell->min_y ? quad[i].y : cell->min_y;
+		cell->max_x = quad[i].x > cell->max_x ? quad[i].x : cell->max_x;
+		cell->max_y = quad[i].y > cell->max_y ? quad[i].y : cell->max_y;
+	}
+}
+
+/* sorts the sprites by their textures and grid cells and records the cell
+ * bounds, the batches without cell size have a single cell per texture */
+static int build_static_cells(struct BLZ_StaticBatch *batch)
+{
+	struct BLZ_SpriteQuad tmp, *quads = (struct BLZ_SpriteQuad *)batch->vertices;
+	struct StaticCell *cell = NULL;
+	int i, j, k, cell_count = 0, result;
+#ifdef BLZ_CONFIG_STATIC
+	struct CellKey *keys = __scratch.cell_keys;
+#else
+	struct CellKey *keys = blz_malloc(MEMORY_TEMPORARY,
+									  batch->sprite_count * sizeof(struct CellKey));
+	check_alloc(keys);
+#endif
+	for (i = 0; i < batch->sprite_count; i++)
+	{
+		keys[i].texture = batch->textures[i];
+		keys[i].index = i;
 	}
-	if (__lastTexture > 0 && texture == __lastTexture)
+	qsort(keys, batch->sprite_count, sizeof(struct CellKey), compare_key_textures);
+	for (i = 0; i < batch->sprite_count; i++)
 	{
-		if (__lastBucket != NULL && __lastBucket->sprite_count < batch->max_sprites_per_bucket)
+		keys[i].order = i > 0 && keys[i].texture == keys[i - 1].texture
+							? keys[i - 1].order
+							: keys[i].index;
+		/* the sprite belongs to the cell of its center */
+		k = keys[i].index;
+		keys[i].x = keys[i].y = 0;
+		if (batch->cell_size > 0)
 		{
-			bucket = __lastBucket;
+			keys[i].x = (int)floor((quads[k].vertices[0].x + quads[k].vertices[3].x) /
+								   2 / batch->cell_size);
+			keys[i].y = (int)floor((quads[k].vertices[0].y + quads[k].vertices[3].y) /
+								   2 / batch->cell_size);
 		}
 	}
-	if (bucket == NULL)
+	qsort(keys, batch->sprite_count, sizeof(struct CellKey), compare_cell_keys);
+	for (i = 0; i < batch->sprite_count; i++)
 	{
-		for (i = 0; i < batch->max_buckets; i++)
+		cell_count += is_new_cell(keys, i);
+	}
+	result = alloc_static_cells(batch, cell_count);
+	if (result)
+	{
+		batch->cell_count = cell_count;
+		for (i = 0; i < batch->sprite_count; i++)
 		{
-			bucket = (batch->sprite_buckets + i);
-			if (bucket->texture == texture &&
-				bucket->sprite_count >= batch->max_sprites_per_bucket)
+			batch->slots[keys[i].index] = i;
+		}
+		/* moves the sprites to their sorted places following the cycles of
+		 * the permutation, the placed ones are marked by negative index */
+		for (i = 0; i < batch->sprite_count; i++)
+		{
+			if (keys[i].index < 0)
 			{
-				/* this bucket is already filled, skip it */
 				continue;
 			}
-			if (bucket->texture == texture || bucket->texture == 0)
+			tmp = quads[i];
+			for (j = i;; j = k)
 			{
-				/* we found existing not-full bucket or an empty one */
-				break;
+				k = keys[j].index;
+				keys[j].index = -1;
+				if (k == i)
+				{
+					quads[j] = tmp;
+					break;
+				}
+				quads[j] = quads[k];
+			}
+		}
+		for (i = 0; i < batch->sprite_count; i++)
+		{
+			batch->textures[i] = keys[i].texture;
+			if (is_new_cell(keys, i))
+			{
+				cell = cell == NULL ? batch->cells : cell + 1;
+				cell->min_x = cell->max_x = quads[i].vertices[0].x;
+				cell->min_y = cell->max_y = quads[i].vertices[0].y;
+				cell->texture = keys[i].texture;
+				cell->first = i;
+				cell->count = 0;
 			}
+			grow_cell(cell, quads[i].vertices);
+			cell->count++;
+		}
+	}
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(keys);
+#endif
+	return result;
+}
+
+static int uses_cells(const struct BLZ_StaticBatch *batch)
+{
+	return batch->cell_size > 0 || batch->mixed_textures;
+}
+
+#ifdef BLZ_CONFIG_STATIC
+#define HAS_CPU_COPY(batch) BLZ_TRUE
+#else
+#define HAS_CPU_COPY(batch) ((batch)->vertices != NULL)
+#endif
+
+/* count of quads which are converted to the quantized layout at once */
+#define QUANTIZE_CHUNK 256
+
+static GLshort quantize_position(GLfloat value)
+{
+	value = (GLfloat)floor(value + 0.5f);
+	return (GLshort)(value < SHRT_MIN ? SHRT_MIN : value > SHRT_MAX ? SHRT_MAX : value);
+}
+
+static GLushort quantize_unorm16(GLfloat value)
+{
+	value = value < 0 ? 0 : value > 1 ? 1 : value;
+	return (GLushort)(value * USHRT_MAX + 0.5f);
+}
+
+static GLubyte quantize_unorm8(GLfloat value)
+{
+	value = value < 0 ? 0 : value > 1 ? 1 : value;
+	return (GLubyte)(value * UCHAR_MAX + 0.5f);
+}
+
+/* replaces the float vertex attributes of the buffer with quantized ones */
+static void set_quantized_layout(struct Buffer *buffer, int max_sprites)
+{
+	const GLsizei size = sizeof(struct QuantizedVertex);
+	state_bind_vao(buffer->vao);
+	state_bind_array_buffer(buffer->vbo);
+	glBufferData(GL_ARRAY_BUFFER, size * 4 * max_sprites, NULL, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, size,
+						  (void *)offsetof(struct QuantizedVertex, x));
+	glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, size,
+						  (void *)offsetof(struct QuantizedVertex, u));
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, size,
+						  (void *)offsetof(struct QuantizedVertex, r));
+	state_bind_vao(0);
+}
+
+static void write_static_quads(
+	struct BLZ_StaticBatch *batch,
+	int first,
+	int count,
+	const struct BLZ_Vertex *vertices)
+{
+	struct QuantizedVertex chunk[QUANTIZE_CHUNK * 4];
+	int done, i, size;
+	state_bind_array_buffer(batch->buffer.vbo);
+	if (!(batch->flags & QUANTIZED))
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(struct BLZ_SpriteQuad),
+						count * sizeof(struct BLZ_SpriteQuad), vertices);
+		return;
+	}
+	for (done = 0; done < count; done += size)
+	{
+		size = count - done < QUANTIZE_CHUNK ? count - done : QUANTIZE_CHUNK;
+		for (i = 0; i < size * 4; i++)
+		{
+			chunk[i].x = quantize_position(vertices[done * 4 + i].x);
+			chunk[i].y = quantize_position(vertices[done * 4 + i].y);
+			chunk[i].u = quantize_unorm16(vertices[done * 4 + i].u);
+			chunk[i].v = quantize_unorm16(vertices[done * 4 + i].v);
+			chunk[i].r = quantize_unorm8(vertices[done * 4 + i].r);
+			chunk[i].g = quantize_unorm8(vertices[done * 4 + i].g);
+			chunk[i].b = quantize_unorm8(vertices[done * 4 + i].b);
+			chunk[i].a = quantize_unorm8(vertices[done * 4 + i].a);
 		}
+		glBufferSubData(GL_ARRAY_BUFFER,
+						(first + done) * 4 * sizeof(struct QuantizedVertex),
+						size * 4 * sizeof(struct QuantizedVertex), chunk);
 	}
-	if (bucket->sprite_count >= batch->max_sprites_per_bucket ||
-		(bucket->texture != 0 && bucket->texture != texture))
+}
+
+static int upload_static_vertices(struct BLZ_StaticBatch *batch)
+{
+	if (uses_cells(batch) && !build_static_cells(batch))
 	{
-		/* we ran out of limits */
-		fail("Sprite limit reached - increase limits in BLZ_CreateBatch(...)");
+		return BLZ_FALSE;
 	}
-	offset = bucket->sprite_count * 4;
-	/* set the vertex data */
-	memcpy((bucket->vertices + offset), quad, sizeof(struct BLZ_SpriteQuad));
-	bucket->sprite_count++;
-	bucket->texture = texture;
-	__lastBatch = batch;
-	__lastBucket = bucket;
-	__lastTexture = texture;
+	/* the buffer keeps the space for the sprites appended later */
+	write_static_quads(batch, 0, batch->sprite_count, batch->vertices);
+	batch->is_uploaded = BLZ_TRUE;
+	batch->dirty_count = 0;
+#ifndef BLZ_CONFIG_STATIC
+	if (batch->flags & DISCARD_CPU_COPY)
+	{
+		blz_free(batch->vertices);
+		batch->vertices = NULL;
+	}
+#endif
 	success();
 }
 
-/* Static drawing */
-static void upload_static_vertices(struct BLZ_StaticBatch *batch)
+static void mark_static_dirty(struct BLZ_StaticBatch *batch, int first, int end)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, batch->buffer.vbo);
-	glBufferData(GL_ARRAY_BUFFER,
-				 batch->sprite_count * 4 * sizeof(struct BLZ_Vertex),
-				 batch->vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	batch->is_uploaded = BLZ_TRUE;
+	struct DirtyRange *range;
+	int i;
+	if (!batch->is_uploaded)
+	{
+		return;
+	}
+	for (i = 0; i < batch->dirty_count; i++)
+	{
+		range = batch->dirty + i;
+		/* overlapping or adjacent */
+		if (first <= range->end && end >= range->first)
+		{
+			range->first = first < range->first ? first : range->first;
+			range->end = end > range->end ? end : range->end;
+			return;
+		}
+	}
+	if (batch->dirty_count == MAX_DIRTY_RANGES)
+	{
+		/* too many scattered changes, upload everything between them */
+		for (i = 0; i < batch->dirty_count; i++)
+		{
+			first = batch->dirty[i].first < first ? batch->dirty[i].first : first;
+			end = batch->dirty[i].end > end ? batch->dirty[i].end : end;
+		}
+		batch->dirty_count = 0;
+		mark_static_dirty(batch, first, end);
+		return;
+	}
+	batch->dirty[batch->dirty_count].first = first;
+	batch->dirty[batch->dirty_count++].end = end;
+}
+
+static void upload_static_ranges(struct BLZ_StaticBatch *batch)
+{
+	const struct DirtyRange *range;
+	int i;
+	for (i = 0; i < batch->dirty_count; i++)
+	{
+		range = batch->dirty + i;
+		write_static_quads(batch, range->first, range->end - range->first,
+						   batch->vertices + range->first * 4);
+	}
+	batch->dirty_count = 0;
+}
+
+/* without the CPU copy the changes are uploaded immediately */
+static void set_static_quad(
+	struct BLZ_StaticBatch *batch,
+	int slot,
+	const struct BLZ_SpriteQuad *quad)
+{
+	if (!HAS_CPU_COPY(batch))
+	{
+		write_static_quads(batch, slot, 1, quad->vertices);
+		return;
+	}
+	memcpy(batch->vertices + slot * 4, quad, sizeof(struct BLZ_SpriteQuad));
+	mark_static_dirty(batch, slot, slot + 1);
+}
+
+/* cell which holds the sprite at the specified place */
+static struct StaticCell *find_static_cell(struct BLZ_StaticBatch *batch,
+										   int slot)
+{
+	int low = 0, high = batch->cell_count - 1, middle;
+	while (low < high)
+	{
+		middle = (low + high + 1) / 2;
+		if (batch->cells[middle].first <= slot)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	return batch->cells + low;
+}
+
+/* the sprites appended after upload don't change the order of the others,
+ * they extend the last cell or start a new one */
+static int append_static_cell(struct BLZ_StaticBatch *batch, int slot,
+							  const struct BLZ_Vertex *quad)
+{
+	struct StaticCell *cell;
+	int i;
+	if (!uses_cells(batch))
+	{
+		if (batch->textures[slot] == batch->textures[0])
+		{
+			success();
+		}
+		/* the existing sprites become a single cell */
+		if (!alloc_static_cells(batch, 2))
+		{
+			return BLZ_FALSE;
+		}
+		cell = batch->cells;
+		cell->texture = batch->textures[0];
+		cell->first = 0;
+		cell->count = slot;
+		if (HAS_CPU_COPY(batch))
+		{
+			cell->min_x = cell->max_x = batch->vertices[0].x;
+			cell->min_y = cell->max_y = batch->vertices[0].y;
+			for (i = 0; i < slot; i++)
+			{
+				grow_cell(cell, batch->vertices + i * 4);
+			}
+		}
+		else
+		{
+			/* the discarded sprites can be anywhere */
+			cell->min_x = cell->min_y = -FLT_MAX;
+			cell->max_x = cell->max_y = FLT_MAX;
+		}
+		batch->cell_count = 1;
+		batch->mixed_textures = GL_TRUE;
+	}
+	if (batch->cell_count > 0)
+	{
+		cell = batch->cells + batch->cell_count - 1;
+		if (cell->texture == batch->textures[slot] &&
+			cell->first + cell->count == slot)
+		{
+			grow_cell(cell, quad);
+			cell->count++;
+			success();
+		}
+	}
+	if (!alloc_static_cells(batch, batch->cell_count + 1))
+	{
+		return BLZ_FALSE;
+	}
+	cell = batch->cells + batch->cell_count++;
+	cell->min_x = cell->max_x = quad[0].x;
+	cell->min_y = cell->max_y = quad[0].y;
+	cell->texture = batch->textures[slot];
+	cell->first = slot;
+	cell->count = 1;
+	grow_cell(cell, quad);
+	success();
+}
+
+/* a cell is invisible if all of its corners are outside of the same clip
+ * plane after transformation */
+static int is_cell_visible(const struct StaticCell *cell, const GLfloat *mvp)
+{
+	GLfloat x, y, clip_x, clip_y, clip_w;
+	int i, outside = 0xF;
+	for (i = 0; i < 4; i++)
+	{
+		x = (i & 1) ? cell->max_x : cell->min_x;
+		y = (i & 2) ? cell->max_y : cell->min_y;
+		clip_x = mvp[0] * x + mvp[4] * y + mvp[12];
+		clip_y = mvp[1] * x + mvp[5] * y + mvp[13];
+		clip_w = mvp[3] * x + mvp[7] * y + mvp[15];
+		outside &= (clip_x < -clip_w ? 1 : 0) | (clip_x > clip_w ? 2 : 0) |
+				   (clip_y < -clip_w ? 4 : 0) | (clip_y > clip_w ? 8 : 0);
+	}
+	return outside == 0;
+}
+
+/* fills the index ranges of the visible cells, merging the adjacent ones
+ * with the same texture, and returns the count of ranges */
+static int cull_static_cells(struct BLZ_StaticBatch *batch, const GLfloat *mvp)
+{
+	const struct StaticCell *cell;
+	int i, draws = 0, index_size = INDEX_SIZE(batch->index_type);
+	int next = -1;
+	for (i = 0; i < batch->cell_count; i++)
+	{
+		cell = batch->cells + i;
+		if (batch->cell_size > 0 && !is_cell_visible(cell, mvp))
+		{
+			continue;
+		}
+		if (cell->first == next && batch->range_textures[draws - 1] == cell->texture)
+		{
+			batch->counts[draws - 1] += cell->count * 6;
+		}
+		else
+		{
+			batch->offsets[draws] = (const GLvoid *)(size_t)(cell->first * 6 * index_size);
+			batch->counts[draws] = cell->count * 6;
+			batch->range_textures[draws++] = cell->texture;
+		}
+		next = cell->first + cell->count;
+	}
+	return draws;
 }
 
 struct BLZ_StaticBatch *BLZ_CreateStatic(
 	const struct BLZ_Texture *texture, int max_sprite_count)
 {
-	struct BLZ_StaticBatch *result = malloc(sizeof(struct BLZ_StaticBatch));
+	return BLZ_CreateStaticEx(texture, max_sprite_count, 0, STATIC_DEFAULT);
+}
+
+struct BLZ_StaticBatch *BLZ_CreateStaticEx(
+	const struct BLZ_Texture *texture,
+	int max_sprite_count,
+	float cell_size,
+	enum BLZ_StaticFlags flags)
+{
+	struct BLZ_StaticBatch *result;
+	null_if_invalid(cell_size >= 0);
+#ifdef BLZ_CONFIG_STATIC
+	null_if_invalid(max_sprite_count <= BLZ_MAX_STATIC_SPRITES);
+#endif
+	result = new_object(staticBatchPool, MEMORY_BATCHES,
+						struct BLZ_StaticBatch);
+	check_alloc(result);
 	result->texture = texture;
-	result->buffer = create_buffer(max_sprite_count, GL_STATIC_DRAW);
+	result->index_type = max_sprite_count > MAX_SHORT_INDEXED_SPRITES
+							 ? GL_UNSIGNED_INT
+							 : GL_UNSIGNED_SHORT;
+	result->buffer = create_buffer_indexed(max_sprite_count, GL_STATIC_DRAW,
+										   result->index_type, BLZ_FALSE);
+	if (flags & QUANTIZED)
+	{
+		set_quantized_layout(&result->buffer, max_sprite_count);
+	}
+	result->flags = flags;
 	result->is_uploaded = BLZ_FALSE;
 	result->sprite_count = 0;
 	result->max_sprite_count = max_sprite_count;
-	result->vertices = malloc(max_sprite_count * 4 * sizeof(struct BLZ_Vertex));
+	result->cell_size = cell_size;
+	result->mixed_textures = GL_FALSE;
+	result->cell_count = 0;
+	result->cell_capacity = 0;
+	result->dirty_count = 0;
+#ifndef BLZ_CONFIG_STATIC
+	result->cells = NULL;
+	result->offsets = NULL;
+	result->counts = NULL;
+	result->range_textures = NULL;
+	result->vertices = blz_malloc(MEMORY_VERTICES,
+								  max_sprite_count * 4 * sizeof(struct BLZ_Vertex));
+	result->textures = blz_malloc(MEMORY_VERTICES,
+								  max_sprite_count * sizeof(GLuint));
+	result->slots = blz_malloc(MEMORY_VERTICES, max_sprite_count * sizeof(int));
+	if (result->vertices == NULL || result->textures == NULL ||
+		result->slots == NULL)
+	{
+		blz_free(result->vertices);
+		blz_free(result->textures);
+		blz_free(result->slots);
+		free_buffer(result->buffer);
+		blz_free(result);
+		fail("Could not allocate memory");
+	}
+#endif
 	return result;
 }
 
@@ -841,16 +4899,131 @@ int BLZ_FreeBatchStatic(
 {
 	if (batch == NULL)
 	{
-		success();
+		success();
+	}
+#ifndef BLZ_CONFIG_STATIC
+	blz_free(batch->vertices);
+	blz_free(batch->textures);
+	blz_free(batch->slots);
+	/* the cell arrays start with the offsets */
+	blz_free(batch->offsets);
+#endif
+	free_buffer(batch->buffer);
+	delete_object(staticBatchPool, batch);
+	success();
+}
+
+int BLZ_DrawStatic(
+	struct BLZ_StaticBatch *batch,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad;
+	validate(batch->texture != NULL);
+	quad = transform(
+		batch->texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawStatic(batch, &quad);
+}
+
+int BLZ_DrawStaticDef(
+	struct BLZ_StaticBatch *batch,
+	const struct BLZ_SpriteDef *def,
+	const struct BLZ_Vector2 position,
+	float rotation,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform_def(
+		def,
+		position,
+		rotation,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawStaticTexture(batch, def->texture->id, &quad);
+}
+
+int BLZ_LowerDrawStatic(
+	struct BLZ_StaticBatch *batch,
+	const struct BLZ_SpriteQuad *quad)
+{
+	validate(batch->texture != NULL);
+	return BLZ_LowerDrawStaticTexture(batch, batch->texture->id, quad);
+}
+
+int BLZ_DrawStaticTexture(
+	struct BLZ_StaticBatch *batch,
+	const struct BLZ_Texture *texture,
+	const struct BLZ_Vector2 position,
+	const struct BLZ_Rectangle *srcRectangle,
+	float rotation,
+	const struct BLZ_Vector2 *origin,
+	const struct BLZ_Vector2 *scale,
+	const struct BLZ_Vector4 color,
+	enum BLZ_SpriteFlip effects)
+{
+	struct BLZ_SpriteQuad quad = transform(
+		texture,
+		position,
+		srcRectangle,
+		rotation,
+		origin,
+		scale,
+		color,
+		effects);
+	return BLZ_LowerDrawStaticTexture(batch, texture->id, &quad);
+}
+
+int BLZ_LowerDrawStaticTexture(
+	struct BLZ_StaticBatch *batch,
+	GLuint texture,
+	const struct BLZ_SpriteQuad *quad)
+{
+	int slot = batch->sprite_count;
+	if (slot >= batch->max_sprite_count)
+	{
+		fail("Sprite limit reached - increase limits in BLZ_CreateStatic(...)");
+	}
+	batch->textures[slot] = texture;
+	batch->slots[slot] = slot;
+	if (batch->is_uploaded)
+	{
+		if (!append_static_cell(batch, slot, quad->vertices))
+		{
+			return BLZ_FALSE;
+		}
+		set_static_quad(batch, slot, quad);
 	}
-	free(batch->vertices);
-	free_buffer(batch->buffer);
-	free(batch);
+	else
+	{
+		/* set the vertex data */
+		memcpy((batch->vertices + slot * 4), quad, sizeof(struct BLZ_SpriteQuad));
+		if (texture != batch->textures[0])
+		{
+			batch->mixed_textures = GL_TRUE;
+		}
+	}
+	batch->sprite_count++;
 	success();
 }
 
-int BLZ_DrawStatic(
+int BLZ_ReplaceStatic(
 	struct BLZ_StaticBatch *batch,
+	int index,
+	const struct BLZ_Texture *texture,
 	const struct BLZ_Vector2 position,
 	const struct BLZ_Rectangle *srcRectangle,
 	float rotation,
@@ -860,7 +5033,7 @@ int BLZ_DrawStatic(
 	enum BLZ_SpriteFlip effects)
 {
 	struct BLZ_SpriteQuad quad = transform(
-		batch->texture,
+		texture,
 		position,
 		srcRectangle,
 		rotation,
@@ -868,24 +5041,46 @@ int BLZ_DrawStatic(
 		scale,
 		color,
 		effects);
-	return BLZ_LowerDrawStatic(batch, &quad);
+	validate(index >= 0 && index < batch->sprite_count);
+	validate(texture->id == batch->textures[batch->slots[index]]);
+	return BLZ_LowerReplaceStatic(batch, index, &quad);
 }
 
-int BLZ_LowerDrawStatic(
+int BLZ_LowerReplaceStatic(
 	struct BLZ_StaticBatch *batch,
+	int index,
 	const struct BLZ_SpriteQuad *quad)
 {
-	if (batch->is_uploaded)
+	int slot;
+	validate(index >= 0 && index < batch->sprite_count);
+	slot = batch->slots[index];
+	if (batch->is_uploaded && batch->cell_count > 0)
 	{
-		fail("Can't push more sprites to already uploaded static batch");
+		/* the cell grows, so the sprite is not culled if it moves out */
+		grow_cell(find_static_cell(batch, slot), quad->vertices);
 	}
-	if (batch->sprite_count >= batch->max_sprite_count)
+	set_static_quad(batch, slot, quad);
+	success();
+}
+
+int BLZ_HideStatic(struct BLZ_StaticBatch *batch, int index)
+{
+	struct BLZ_SpriteQuad hidden;
+	int slot, i;
+	validate(index >= 0 && index < batch->sprite_count);
+	slot = batch->slots[index];
+	memset(&hidden, 0, sizeof(hidden));
+	if (HAS_CPU_COPY(batch))
 	{
-		fail("Sprite limit reached - increase limits in BLZ_CreateStatic(...)");
+		memcpy(&hidden, batch->vertices + slot * 4, sizeof(hidden));
 	}
-	/* set the vertex data */
-	memcpy((batch->vertices + batch->sprite_count * 4), quad, sizeof(struct BLZ_SpriteQuad));
-	batch->sprite_count++;
+	/* the degenerate triangles are not rasterized */
+	for (i = 1; i < 4; i++)
+	{
+		hidden.vertices[i].x = hidden.vertices[0].x;
+		hidden.vertices[i].y = hidden.vertices[0].y;
+	}
+	set_static_quad(batch, slot, &hidden);
 	success();
 }
 
@@ -923,21 +5118,369 @@ int BLZ_PresentStatic(
 	const GLfloat *transform = transformMatrix4x4 != NULL ? transformMatrix4x4 : (GLfloat *)&identityMatrix;
 
 	GLfloat mvpMatrix[16];
-	if (!batch->is_uploaded)
+	int i, first, draws = 1;
+	flush_immediate();
+	if (!batch->is_uploaded && !upload_static_vertices(batch))
+	{
+		return BLZ_FALSE;
+	}
+	upload_static_ranges(batch);
+	if (batch->sprite_count == 0)
+	{
+		success();
+	}
+	mult_4x4_matrix(transform, (GLfloat *)&orthoMatrix, (GLfloat *)&mvpMatrix);
+	if (uses_cells(batch))
+	{
+		draws = cull_static_cells(batch, mvpMatrix);
+	}
+	if (__activeQueue != NULL)
+	{
+		return queue_static(batch, mvpMatrix, draws);
+	}
+	if (draws == 0)
 	{
-		upload_static_vertices(batch);
+		success();
 	}
 	if (SHADER_CURRENT->mvp_param > -1)
 	{
-		mult_4x4_matrix(transform, (GLfloat *)&orthoMatrix, (GLfloat *)&mvpMatrix);
 		set_mvp_matrix((const GLfloat *)&mvpMatrix);
 	}
-	bind_tex0(batch->texture->id);
-	glBindVertexArray(batch->buffer.vao);
-	glDrawElements(GL_TRIANGLES, batch->sprite_count * 6, GL_UNSIGNED_SHORT, (void *)0);
+	state_bind_vao(batch->buffer.vao);
+	if (!uses_cells(batch))
+	{
+		bind_tex0(batch->textures[0]);
+		glDrawElements(GL_TRIANGLES, batch->sprite_count * 6, batch->index_type,
+					   (void *)0);
+		success();
+	}
+	/* the ranges are grouped by texture, one bind per group */
+	for (first = 0; first < draws; first = i)
+	{
+		for (i = first + 1; i < draws; i++)
+		{
+			if (batch->range_textures[i] != batch->range_textures[first])
+			{
+				break;
+			}
+		}
+		bind_tex0(batch->range_textures[first]);
+		if (i - first == 1)
+		{
+			glDrawElements(GL_TRIANGLES, batch->counts[first], batch->index_type,
+						   batch->offsets[first]);
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLES, batch->counts + first,
+								batch->index_type, batch->offsets + first,
+								i - first);
+		}
+	}
+	success();
+}
+
+#define STATIC_MAGIC 0x535A4C42u /* "BLZS" */
+/* count of distinct textures of the saved static batch */
+#define MAX_SAVED_TEXTURES 64
+
+/* written before the sprite data, followed by the places of the sprites,
+ * their texture indices, the cells and the vertices */
+struct StaticFileHeader
+{
+	unsigned int magic;
+	int vertex_size;
+	int flags;
+	int sprite_count;
+	int max_sprite_count;
+	int texture_count;
+	int cell_count;
+	int mixed_textures;
+	GLfloat cell_size;
+};
+
+static int static_vertex_size(enum BLZ_StaticFlags flags)
+{
+	return flags & QUANTIZED ? sizeof(struct QuantizedVertex)
+							 : sizeof(struct BLZ_Vertex);
+}
+
+static int saved_texture_index(const GLuint *textures, int count,
+							   GLuint texture)
+{
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		if (textures[i] == texture)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int write_static_vertices(struct BLZ_StaticBatch *batch, FILE *file)
+{
+	const size_t count = batch->sprite_count * 4;
+	const size_t size = static_vertex_size(batch->flags);
+	const void *vertices;
+	int result;
+	if (count == 0)
+	{
+		success();
+	}
+	state_bind_array_buffer(batch->buffer.vbo);
+	vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * size, GL_MAP_READ_BIT);
+	fail_if_null(vertices, "Could not map the vertex buffer");
+	result = fwrite(vertices, size, count, file) == count;
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	return result;
+}
+
+int BLZ_SaveStatic(
+	struct BLZ_StaticBatch *batch,
+	const char *path)
+{
+	FILE *file;
+	struct StaticFileHeader header;
+	struct StaticCell cell;
+	GLuint textures[MAX_SAVED_TEXTURES];
+	int i, index, written;
+	validate(batch != NULL && path != NULL);
+	/* the saved sprites are the uploaded ones */
+	if (!batch->is_uploaded && !upload_static_vertices(batch))
+	{
+		return BLZ_FALSE;
+	}
+	upload_static_ranges(batch);
+	header.texture_count = 0;
+	for (i = 0; i < batch->sprite_count; i++)
+	{
+		if (saved_texture_index(textures, header.texture_count,
+								batch->textures[i]) >= 0)
+		{
+			continue;
+		}
+		if (header.texture_count == MAX_SAVED_TEXTURES)
+		{
+			fail("Too many textures in the static batch");
+		}
+		textures[header.texture_count++] = batch->textures[i];
+	}
+	header.magic = STATIC_MAGIC;
+	header.vertex_size = static_vertex_size(batch->flags);
+	header.flags = batch->flags;
+	header.sprite_count = batch->sprite_count;
+	header.max_sprite_count = batch->max_sprite_count;
+	header.cell_count = batch->cell_count;
+	header.mixed_textures = batch->mixed_textures;
+	header.cell_size = batch->cell_size;
+	file = fopen(path, "wb");
+	fail_if_null(file, "Could not open the file for writing");
+	written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			  fwrite(batch->slots, sizeof(int), batch->sprite_count, file) ==
+				  (size_t)batch->sprite_count;
+	for (i = 0; i < batch->sprite_count && written; i++)
+	{
+		index = saved_texture_index(textures, header.texture_count,
+									batch->textures[i]);
+		written = fwrite(&index, sizeof(int), 1, file) == 1;
+	}
+	for (i = 0; i < batch->cell_count && written; i++)
+	{
+		cell = batch->cells[i];
+		cell.texture = saved_texture_index(textures, header.texture_count,
+										   cell.texture);
+		written = fwrite(&cell, sizeof(cell), 1, file) == 1;
+	}
+	written = written && write_static_vertices(batch, file);
+	written = fclose(file) == 0 && written;
+	fail_if_false(written, "Could not write the static batch file");
+	success();
+}
+
+static int is_valid_static_header(const struct StaticFileHeader *header,
+								  int texture_count)
+{
+	return header->magic == STATIC_MAGIC &&
+		   header->vertex_size == static_vertex_size(header->flags) &&
+		   header->sprite_count >= 0 &&
+		   header->sprite_count <= header->max_sprite_count &&
+		   header->texture_count <= texture_count &&
+		   header->cell_count >= 0 &&
+		   header->cell_count <= header->sprite_count &&
+		   header->cell_size >= 0;
+}
+
+static int read_texture_index(FILE *file, const struct BLZ_Texture **textures,
+							  int texture_count, GLuint *texture)
+{
+	int index;
+	if (fread(&index, sizeof(int), 1, file) != 1 ||
+		index < 0 || index >= texture_count || textures[index] == NULL)
+	{
+		fail("Invalid static batch file");
+	}
+	*texture = textures[index]->id;
+	success();
+}
+
+static int read_static_vertices(struct BLZ_StaticBatch *batch, FILE *file)
+{
+	struct QuantizedVertex chunk[QUANTIZE_CHUNK * 4];
+	struct BLZ_Vertex *vertex;
+	const size_t count = batch->sprite_count * 4;
+	const size_t size = static_vertex_size(batch->flags);
+	size_t done, length, i;
+	void *dest;
+	int result;
+	if (count == 0)
+	{
+		success();
+	}
+	state_bind_array_buffer(batch->buffer.vbo);
+	if (!HAS_CPU_COPY(batch))
+	{
+		/* the file is read straight into the buffer */
+		dest = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * size,
+								GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		fail_if_null(dest, "Could not map the vertex buffer");
+		result = fread(dest, size, count, file) == count;
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		fail_if_false(result, "Could not read the static batch file");
+		success();
+	}
+	if (!(batch->flags & QUANTIZED))
+	{
+		if (fread(batch->vertices, size, count, file) != count)
+		{
+			fail("Could not read the static batch file");
+		}
+		write_static_quads(batch, 0, batch->sprite_count, batch->vertices);
+		success();
+	}
+	/* the copy is restored from the quantized vertices */
+	for (done = 0; done < count; done += length)
+	{
+		length = count - done < QUANTIZE_CHUNK * 4 ? count - done : QUANTIZE_CHUNK * 4;
+		if (fread(chunk, size, length, file) != length)
+		{
+			fail("Could not read the static batch file");
+		}
+		for (i = 0; i < length; i++)
+		{
+			vertex = batch->vertices + done + i;
+			vertex->x = chunk[i].x;
+			vertex->y = chunk[i].y;
+			vertex->u = chunk[i].u / (GLfloat)USHRT_MAX;
+			vertex->v = chunk[i].v / (GLfloat)USHRT_MAX;
+			vertex->r = chunk[i].r / (GLfloat)UCHAR_MAX;
+			vertex->g = chunk[i].g / (GLfloat)UCHAR_MAX;
+			vertex->b = chunk[i].b / (GLfloat)UCHAR_MAX;
+			vertex->a = chunk[i].a / (GLfloat)UCHAR_MAX;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, done * size, length * size, chunk);
+	}
 	success();
 }
 
+static int read_static_batch(
+	struct BLZ_StaticBatch *batch,
+	const struct StaticFileHeader *header,
+	const struct BLZ_Texture **textures,
+	int texture_count,
+	FILE *file)
+{
+	struct StaticCell *cell;
+	int i;
+	const int sprite_count = header->sprite_count;
+	if (fread(batch->slots, sizeof(int), sprite_count, file) !=
+		(size_t)sprite_count)
+	{
+		fail("Invalid static batch file");
+	}
+	for (i = 0; i < sprite_count; i++)
+	{
+		if (batch->slots[i] < 0 || batch->slots[i] >= sprite_count ||
+			!read_texture_index(file, textures, texture_count,
+								batch->textures + i))
+		{
+			fail("Invalid static batch file");
+		}
+	}
+	if (header->cell_count > 0 && !alloc_static_cells(batch, header->cell_count))
+	{
+		return BLZ_FALSE;
+	}
+	for (i = 0; i < header->cell_count; i++)
+	{
+		cell = batch->cells + i;
+		if (fread(cell, sizeof(struct StaticCell), 1, file) != 1 ||
+			cell->texture >= (GLuint)texture_count ||
+			cell->first < 0 || cell->count < 0 ||
+			cell->first + cell->count > sprite_count)
+		{
+			fail("Invalid static batch file");
+		}
+		cell->texture = textures[cell->texture]->id;
+	}
+	batch->sprite_count = sprite_count;
+	batch->cell_count = header->cell_count;
+	batch->mixed_textures = (GLboolean)header->mixed_textures;
+#ifndef BLZ_CONFIG_STATIC
+	if (batch->flags & DISCARD_CPU_COPY)
+	{
+		blz_free(batch->vertices);
+		batch->vertices = NULL;
+	}
+#endif
+	batch->is_uploaded = BLZ_TRUE;
+	return read_static_vertices(batch, file);
+}
+
+struct BLZ_StaticBatch *BLZ_LoadStatic(
+	const char *path,
+	const struct BLZ_Texture *texture)
+{
+	return BLZ_LoadStaticEx(path, &texture, 1);
+}
+
+struct BLZ_StaticBatch *BLZ_LoadStaticEx(
+	const char *path,
+	const struct BLZ_Texture **textures,
+	int texture_count)
+{
+	FILE *file;
+	struct StaticFileHeader header;
+	struct BLZ_StaticBatch *result = NULL;
+	null_if_invalid(path != NULL && textures != NULL && texture_count > 0);
+	file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		__lastError = "Could not open the static batch file";
+		return NULL;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		!is_valid_static_header(&header, texture_count))
+	{
+		__lastError = "Invalid static batch file";
+	}
+	else
+	{
+		result = BLZ_CreateStaticEx(textures[0], header.max_sprite_count,
+									header.cell_size,
+									(enum BLZ_StaticFlags)header.flags);
+		if (result != NULL &&
+			!read_static_batch(result, &header, textures, texture_count, file))
+		{
+			BLZ_FreeBatchStatic(result);
+			result = NULL;
+		}
+	}
+	fclose(file);
+	return result;
+}
+
 /* Immediate drawing */
 int BLZ_DrawImmediate(
 	const struct BLZ_Texture *texture,
@@ -966,23 +5509,214 @@ int BLZ_LowerDrawImmediate(
 	GLuint texture,
 	const struct BLZ_SpriteQuad *quad)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, immediateBuf.vbo);
+	struct BLZ_SpriteQuad *dest;
+	if (__activeQueue != NULL)
+	{
+		dest = queue_sprites(texture, 1, NULL);
+		fail_if_null(dest, "Render queue limit reached - increase limits in BLZ_CreateRenderQueue(...)");
+		memcpy(dest, quad, SIZE_OF_ONE_QUAD);
+		success();
+	}
+	if (immediateMode == IMMEDIATE_COALESCE)
+	{
+		if (texture != immediateTexture ||
+			immediateCount >= BLZ_IMMEDIATE_RING_SIZE)
+		{
+			flush_immediate();
+		}
+		memcpy(immediateQuads + immediateCount, quad, SIZE_OF_ONE_QUAD);
+		immediateCount++;
+		immediateTexture = texture;
+		success();
+	}
+	state_bind_array_buffer(immediateBuf.vbo);
 	glBufferData(GL_ARRAY_BUFFER, SIZE_OF_ONE_QUAD, quad, GL_STREAM_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(immediateBuf.vao);
+	state_bind_vao(immediateBuf.vao);
 	set_mvp_matrix((const GLfloat *)&orthoMatrix);
 	bind_tex0(texture);
 	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, (void *)0);
 	success();
 }
 
+static void flush_immediate()
+{
+	const GLsizeiptr size = immediateCount * SIZE_OF_ONE_QUAD;
+	void *dest;
+	if (immediateCount == 0)
+	{
+		return;
+	}
+	state_bind_array_buffer(immediateRing.vbo);
+	if (immediateRingOffset + immediateCount > BLZ_IMMEDIATE_RING_SIZE)
+	{
+		/* start over in a fresh storage, the GPU may still read the old one */
+		glBufferData(GL_ARRAY_BUFFER, BLZ_IMMEDIATE_RING_SIZE * SIZE_OF_ONE_QUAD,
+					 NULL, GL_STREAM_DRAW);
+		immediateRingOffset = 0;
+	}
+	/* the range was never written since the last orphaning, so no sync */
+	dest = glMapBufferRange(GL_ARRAY_BUFFER,
+							immediateRingOffset * SIZE_OF_ONE_QUAD, size,
+							GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+								GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dest != NULL)
+	{
+		memcpy(dest, immediateQuads, size);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, immediateRingOffset * SIZE_OF_ONE_QUAD,
+						size, immediateQuads);
+	}
+	state_bind_vao(immediateRing.vao);
+	set_mvp_matrix((const GLfloat *)&orthoMatrix);
+	bind_tex0(immediateTexture);
+	glDrawElements(GL_TRIANGLES, immediateCount * 6, GL_UNSIGNED_SHORT,
+				   (void *)(immediateRingOffset * 6 * sizeof(GLushort)));
+	immediateRingOffset += immediateCount;
+	immediateCount = 0;
+}
+
+int BLZ_FlushImmediate()
+{
+	flush_immediate();
+	success();
+}
+
+int BLZ_SetImmediateMode(enum BLZ_ImmediateMode mode)
+{
+	validate(mode == IMMEDIATE_DIRECT || mode == IMMEDIATE_COALESCE);
+	if (mode == immediateMode)
+	{
+		success();
+	}
+	if (mode == IMMEDIATE_COALESCE)
+	{
+#ifndef BLZ_CONFIG_STATIC
+		immediateQuads = blz_malloc(MEMORY_BATCHES,
+									BLZ_IMMEDIATE_RING_SIZE * SIZE_OF_ONE_QUAD);
+		check_alloc(immediateQuads);
+#endif
+		immediateRing = create_buffer(BLZ_IMMEDIATE_RING_SIZE, GL_STREAM_DRAW);
+		immediateRingOffset = 0;
+	}
+	else
+	{
+		flush_immediate();
+		free_buffer(immediateRing);
+#ifndef BLZ_CONFIG_STATIC
+		blz_free(immediateQuads);
+		immediateQuads = NULL;
+#endif
+	}
+	immediateMode = mode;
+	success();
+}
+
 /* Textures */
 static void fill_texture_info(struct BLZ_Texture *texture)
 {
-	glBindTexture(GL_TEXTURE_2D, texture->id);
+	GLuint previous = state_bind_texture_any(texture->id);
 	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texture->width);
 	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texture->height);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	state_restore_texture_any(previous);
+	texture->source_width = texture->width;
+	texture->source_height = texture->height;
+	texture->trim_x = 0;
+	texture->trim_y = 0;
+}
+
+/* crops the image in place to the bounding box of non-transparent pixels,
+ * fully transparent images are cropped to a single pixel */
+static void trim_image(struct BLZ_Texture *texture, unsigned char *data,
+					   int *width, int *height, int channels)
+{
+	int x, y, x1 = *width, y1 = *height, x2 = 0, y2 = 0;
+	int row = *width * channels;
+	if (channels != GRAYSCALE_ALPHA && channels != RGBA)
+	{
+		/* nothing to trim without alpha channel */
+		return;
+	}
+	for (y = 0; y < *height; y++)
+	{
+		for (x = 0; x < *width; x++)
+		{
+			if (data[y * row + x * channels + channels - 1] == 0)
+			{
+				continue;
+			}
+			x1 = x < x1 ? x : x1;
+			y1 = y < y1 ? y : y1;
+			x2 = x + 1 > x2 ? x + 1 : x2;
+			y2 = y + 1 > y2 ? y + 1 : y2;
+		}
+	}
+	if (x2 == 0)
+	{
+		x1 = y1 = 0;
+		x2 = y2 = 1;
+	}
+	texture->trim_x = x1;
+	texture->trim_y = y1;
+	/* the rows are moved towards the start, so they don't overlap */
+	for (y = y1; y < y2; y++)
+	{
+		memmove(data + (y - y1) * (x2 - x1) * channels,
+				data + y * row + x1 * channels,
+				(size_t)(x2 - x1) * channels);
+	}
+	*width = x2 - x1;
+	*height = y2 - y1;
+}
+
+static struct BLZ_Texture *create_texture(
+	unsigned char *data,
+	int width,
+	int height,
+	int channels,
+	unsigned int texture_id,
+	enum BLZ_ImageFlags flags)
+{
+	struct BLZ_Texture *texture;
+	int source_width = width, source_height = height;
+	texture = new_object(texturePool, MEMORY_TEXTURES, struct BLZ_Texture);
+	if (texture == NULL)
+	{
+		SOIL_free_image_data(data);
+		return NULL;
+	}
+	if (flags & TRIM_ALPHA)
+	{
+		trim_image(texture, data, &width, &height, channels);
+	}
+	if (premultipliedAlpha)
+	{
+		flags = (enum BLZ_ImageFlags)(flags | MULTIPLY_ALPHA);
+	}
+	texture->id = SOIL_create_OGL_texture(
+		data, width, height, channels, texture_id, flags & ~TRIM_ALPHA);
+	state_forget_active_texture();
+	SOIL_free_image_data(data);
+	if (!texture->id)
+	{
+		printf("Error: %s\n", SOIL_last_result());
+		delete_object(texturePool, texture);
+		return NULL;
+	}
+	if (!(flags & TRIM_ALPHA))
+	{
+		fill_texture_info(texture);
+		return texture;
+	}
+	/* the sizes are kept in image pixels even if the texture was resized
+	 * to power of two, the source rectangles are defined in them */
+	texture->width = width;
+	texture->height = height;
+	texture->source_width = source_width;
+	texture->source_height = source_height;
+	return texture;
 }
 
 struct BLZ_Texture *BLZ_LoadTextureFromFile(
@@ -992,18 +5726,46 @@ struct BLZ_Texture *BLZ_LoadTextureFromFile(
 	enum BLZ_ImageFlags flags)
 {
 	struct BLZ_Texture *texture;
-	unsigned int id = SOIL_load_OGL_texture(
+	unsigned int id;
+	int width, height, file_channels;
+	unsigned char *data;
+	const char *last_result;
+	if (flags & TRIM_ALPHA)
+	{
+		/* the image data is needed to find the non-transparent part */
+		data = SOIL_load_image(filename, &width, &height, &file_channels,
+							   channels);
+		if (data == NULL)
+		{
+			printf("Error: %s\n", SOIL_last_result());
+			return NULL;
+		}
+		return create_texture(data, width, height,
+							  channels == AUTO ? file_channels : channels,
+							  texture_id, flags);
+	}
+	if (premultipliedAlpha)
+	{
+		flags = (enum BLZ_ImageFlags)(flags | MULTIPLY_ALPHA);
+	}
+	id = SOIL_load_OGL_texture(
 		filename,
 		channels,
 		texture_id,
 		flags);
-	const char *last_result = SOIL_last_result();
+	last_result = SOIL_last_result();
+	state_forget_active_texture();
 	if (!id)
 	{
 		printf("Error: %s\n", last_result);
 		return NULL;
 	}
-	texture = malloc(sizeof(struct BLZ_Texture));
+	texture = new_object(texturePool, MEMORY_TEXTURES, struct BLZ_Texture);
+	if (texture == NULL)
+	{
+		glDeleteTextures(1, &id);
+		return NULL;
+	}
 	texture->id = id;
 	fill_texture_info(texture);
 	return texture;
@@ -1016,7 +5778,6 @@ struct BLZ_Texture *BLZ_LoadTextureFromMemory(
 	unsigned int texture_id,
 	enum BLZ_ImageFlags flags)
 {
-	struct BLZ_Texture *texture;
 	int width, height, channels;
 	unsigned char *data = SOIL_load_image_from_memory(
 		buffer, buffer_length,
@@ -1028,11 +5789,12 @@ struct BLZ_Texture *BLZ_LoadTextureFromMemory(
 		printf("Error: %s\n", last_result);
 		return NULL;
 	}
-	texture = malloc(sizeof(struct BLZ_Texture));
-	texture->id = SOIL_create_OGL_texture(
-		data, width, height, channels, texture_id, flags);
-	fill_texture_info(texture);
-	return texture;
+	if (flags & TRIM_ALPHA && force_channels != AUTO)
+	{
+		/* the data has the forced layout */
+		channels = force_channels;
+	}
+	return create_texture(data, width, height, channels, texture_id, flags);
 }
 
 int BLZ_FreeTexture(struct BLZ_Texture *texture)
@@ -1041,8 +5803,10 @@ int BLZ_FreeTexture(struct BLZ_Texture *texture)
 	{
 		success();
 	}
+	flush_immediate();
+	state_forget_texture(texture->id);
 	glDeleteTextures(1, &texture->id);
-	free(texture);
+	delete_object(texturePool, texture);
 	success();
 }
 
@@ -1052,6 +5816,7 @@ int BLZ_SaveScreenshot(
 	int x, int y,
 	int width, int height)
 {
+	flush_immediate();
 	return SOIL_save_screenshot(
 		filename,
 		format, x, y, width, height);
@@ -1061,37 +5826,62 @@ int BLZ_SaveScreenshot(
 static const GLenum DRAW_BUFFERS[1] = {GL_COLOR_ATTACHMENT0};
 struct BLZ_RenderTarget *BLZ_CreateRenderTarget(int width, int height)
 {
-	GLuint framebuffer, texture;
+	GLuint framebuffer, texture, depth, previous;
 	struct BLZ_RenderTarget *result;
 	glGenFramebuffers(1, &framebuffer);
 	glGenTextures(1, &texture);
+	glGenRenderbuffers(1, &depth);
 	null_if_false(framebuffer, "Could not create framebuffer");
 	null_if_false(texture, "Could not create texture for framebuffer");
-	result = malloc(sizeof(struct BLZ_RenderTarget));
+	null_if_false(depth, "Could not create depth buffer for framebuffer");
+	result = new_object(renderTargetPool, MEMORY_RENDER_TARGETS,
+						struct BLZ_RenderTarget);
+	check_alloc(result);
 	result->id = framebuffer;
+	result->depth = depth;
+	result->depth_slice = 0;
 	result->texture.id = texture;
 	result->texture.width = width;
 	result->texture.height = height;
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	result->texture.source_width = width;
+	result->texture.source_height = height;
+	result->texture.trim_x = 0;
+	result->texture.trim_y = 0;
+	state_bind_framebuffer(framebuffer);
+	previous = state_bind_texture_any(texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
 				 GL_UNSIGNED_BYTE, NULL);
 	BLZ_SetTextureFiltering(&result->texture, NEAREST, NEAREST);
+	state_restore_texture_any(previous);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
 						   texture, 0);
+	/* the opaque batches need the depth test */
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+							  GL_RENDERBUFFER, depth);
 	glDrawBuffers(1, DRAW_BUFFERS);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 	{
-		free(result);
+		state_bind_framebuffer(currentTarget);
+		state_forget_texture(texture);
+		glDeleteTextures(1, &texture);
+		glDeleteRenderbuffers(1, &depth);
+		glDeleteFramebuffers(1, &framebuffer);
+		delete_object(renderTargetPool, result);
 		fail("The specified framebuffer is not complete");
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	state_bind_framebuffer(currentTarget);
 	return result;
 }
 
 int BLZ_BindRenderTarget(struct BLZ_RenderTarget *target)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, target == NULL ? 0 : target->id);
+	flush_immediate();
+	currentTarget = target == NULL ? 0 : target->id;
+	currentDepthSlice = target == NULL ? &screenDepthSlice : &target->depth_slice;
+	state_bind_framebuffer(currentTarget);
 	success();
 }
 
@@ -1100,9 +5890,22 @@ int BLZ_FreeRenderTarget(struct BLZ_RenderTarget *target)
 	if (target == NULL) {
 		success();
 	}
+	flush_immediate();
+	state_forget_texture(target->texture.id);
+	if (currentTarget == target->id)
+	{
+		/* OpenGL falls back to the default framebuffer */
+		currentTarget = 0;
+		currentDepthSlice = &screenDepthSlice;
+	}
+	if (glState.framebuffer == target->id)
+	{
+		glState.framebuffer = 0;
+	}
 	glDeleteTextures(1, &target->texture.id);
+	glDeleteRenderbuffers(1, &target->depth);
 	glDeleteFramebuffers(1, &target->id);
-	free(target);
+	delete_object(renderTargetPool, target);
 	success();
 }
 
@@ -1120,16 +5923,29 @@ int BLZ_FreeRenderTarget(struct BLZ_RenderTarget *target)
 #define UNIFORM_VEC(postfix, type, n)                            \
 	void BLZ_Uniform##n##postfix(GLint location, PARAM##n(type)) \
 	{                                                            \
+		type values[n] = {PASS_PARAM##n};                        \
+		if (is_uniform_unchanged(location, values, sizeof(values))) \
+		{                                                        \
+			return;                                              \
+		}                                                        \
+		flush_immediate();                                       \
 		glUniform##n##postfix(location, PASS_PARAM##n);          \
 	}
 
-#define UNIFORM_MAT(size)                                             \
+#define UNIFORM_MAT(size, elements)                                   \
 	void BLZ_UniformMatrix##size##fv(                                 \
 		GLint location,                                               \
 		GLsizei count,                                                \
 		GLboolean transpose,                                          \
 		const GLfloat *value)                                         \
 	{                                                                 \
+		if (is_uniform_unchanged(location, value,                     \
+								 transpose ? 0 : count * (elements) * \
+													 (GLsizei)sizeof(GLfloat))) \
+		{                                                             \
+			return;                                                   \
+		}                                                             \
+		flush_immediate();                                            \
 		glUniformMatrix##size##fv(location, count, transpose, value); \
 	}
 
@@ -1145,13 +5961,13 @@ UNIFORM_VEC(ui, GLuint, 1)
 UNIFORM_VEC(ui, GLuint, 2)
 UNIFORM_VEC(ui, GLuint, 3)
 UNIFORM_VEC(ui, GLuint, 4)
-UNIFORM_MAT(2)
-UNIFORM_MAT(3)
-UNIFORM_MAT(4)
-UNIFORM_MAT(2x3)
-UNIFORM_MAT(3x2)
-UNIFORM_MAT(2x4)
-UNIFORM_MAT(4x2)
-UNIFORM_MAT(3x4)
-UNIFORM_MAT(4x3)
+UNIFORM_MAT(2, 4)
+UNIFORM_MAT(3, 9)
+UNIFORM_MAT(4, 16)
+UNIFORM_MAT(2x3, 6)
+UNIFORM_MAT(3x2, 6)
+UNIFORM_MAT(2x4, 8)
+UNIFORM_MAT(4x2, 8)
+UNIFORM_MAT(3x4, 12)
+UNIFORM_MAT(4x3, 12)
 /* LCOV_EXCL_STOP */
@@ -26,6 +26,7 @@ SOFTWARE.
 
 #include "stddef.h"
 #include "./cassert.h"
+#include "./blaze_config.h"
 #include "./deps/SOIL/SOIL.h"
 #include "./glad/include/glad/glad.h"
 
@@ -107,6 +108,55 @@ struct BLZ_Texture
 	GLuint id;  /** OpenGL texture id (name) */
 	int width;  /** Texture width in pixels */
 	int height; /** Texture height in pixels */
+	/**
+	 * Image width before trimming, equals width if it wasn't trimmed.
+	 * Textures filled by the caller may leave it 0, they are never trimmed.
+	 */
+	int source_width;
+	/** Image height before trimming, equals height if it wasn't trimmed */
+	int source_height;
+	/** X offset of the trimmed part in the source image */
+	int trim_x;
+	/** Y offset of the trimmed part in the source image */
+	int trim_y;
+};
+
+/**
+ * Precomputed sprite definition - a part of the texture with cached normalized
+ * texture coordinates, size and default origin. Create it once using
+ * \ref BLZ_InitSpriteDef and reuse it for every sprite which shares the same
+ * source rectangle.
+ * @see BLZ_DrawDef
+ * @see BLZ_DrawStaticDef
+ */
+struct BLZ_SpriteDef
+{
+	/** Texture which the sprite belongs to */
+	const struct BLZ_Texture *texture;
+	/** Sprite size in pixels */
+	struct BLZ_Vector2 size;
+	/** The point around which the sprite is positioned and rotated */
+	struct BLZ_Vector2 origin;
+	/** Texture coordinates (u1, v1, u2, v2) for each BLZ_SpriteFlip value */
+	struct BLZ_Vector4 uv[4];
+};
+
+/** Maximum count of vertices of \ref BLZ_SpriteMesh */
+#define BLZ_MESH_MAX_VERTICES 8
+
+/**
+ * Convex polygon around the opaque texels of a sprite, drawing it instead of
+ * the whole rectangle shades fewer transparent pixels. Build it once using
+ * \ref BLZ_BuildSpriteMesh, it doesn't depend on the texture and can be
+ * stored offline.
+ * @see BLZ_DrawMesh
+ */
+struct BLZ_SpriteMesh
+{
+	/** Count of the vertices, 0 if the sprite is fully transparent */
+	int vertex_count;
+	/** Vertices in clockwise order, relative to the source rectangle (0..1) */
+	struct BLZ_Vector2 vertices[BLZ_MESH_MAX_VERTICES];
 };
 
 /**
@@ -132,6 +182,7 @@ enum BLZ_BlendFactor
  * @see BLEND_NORMAL
  * @see BLEND_ADDITIVE
  * @see BLEND_MULTIPLY
+ * @see BLEND_PREMULTIPLIED
  */
 struct BLZ_BlendFunc
 {
@@ -151,6 +202,12 @@ extern const struct BLZ_BlendFunc BLEND_ADDITIVE;
  * Multiplicative blending (src = DST_COLOR, dst = ZERO)
  */
 extern const struct BLZ_BlendFunc BLEND_MULTIPLY;
+/**
+ * Premultiplied alpha blending (src = ONE, dst = ONE_MINUS_SRC_ALPHA).
+ * Expects textures and colors with premultiplied alpha, see
+ * \ref BLZ_SetPremultipliedAlpha.
+ */
+extern const struct BLZ_BlendFunc BLEND_PREMULTIPLIED;
 
 struct BLZ_SpriteBatch;
 /**
@@ -167,18 +224,117 @@ struct BLZ_StaticBatch;
  * like tiles.
  */
 typedef struct BLZ_StaticBatch BLZ_StaticBatch;
+struct BLZ_RenderQueue;
+/**
+ * Defines a queue which records the draws of a frame and executes them
+ * sorted by their state.
+ * @see BLZ_BeginQueue
+ */
+typedef struct BLZ_RenderQueue BLZ_RenderQueue;
 struct BLZ_Shader;
 /**
  * Represents a GLSL shader handle.
  */
 typedef struct BLZ_Shader BLZ_Shader;
 
+/**
+ * Count of additional texture slots (1 to BLZ_MATERIAL_TEXTURES) which can
+ * be set by a material.
+ */
+#define BLZ_MATERIAL_TEXTURES 4
+
+/**
+ * State used for drawing a sprite - shader, blend function and additional
+ * textures. Initialize it using \ref BLZ_InitMaterial. The sprites drawn with
+ * different materials can share a batch, the batch groups them by material
+ * and changes the state only between the groups.
+ * @see BLZ_DrawMaterial
+ */
+struct BLZ_Material
+{
+	/** Shader program, NULL for the default one */
+	struct BLZ_Shader *shader;
+	/** Blend function */
+	struct BLZ_BlendFunc blend;
+	/** Textures bound to slots 1 to BLZ_MATERIAL_TEXTURES, NULL if unused */
+	const struct BLZ_Texture *textures[BLZ_MATERIAL_TEXTURES];
+};
+struct BLZ_UniformBuffer;
+/**
+ * Represents a uniform buffer object which backs a uniform block shared by
+ * the shaders.
+ * @see BLZ_CreateUniformBuffer
+ */
+typedef struct BLZ_UniformBuffer BLZ_UniformBuffer;
+
+/**
+ * Per-frame parameters which are available to every shader as a uniform
+ * block, if the OpenGL implementation supports uniform buffers (3.1+). The
+ * layout matches the following std140 block declaration:
+ * \code
+ * layout(std140) uniform BLZ_FrameData {
+ *   mat4 projection;
+ *   vec2 resolution;
+ *   float time;
+ *   float delta_time;
+ * };
+ * \endcode
+ * The projection and resolution are set by \ref BLZ_SetViewport, the time
+ * values are set by \ref BLZ_SetFrameTime.
+ */
+struct BLZ_FrameData
+{
+	GLfloat projection[16]; /** Orthographic projection of the viewport */
+	GLfloat resolution[2];	/** Viewport size in pixels */
+	GLfloat time;			/** Time passed to BLZ_SetFrameTime */
+	GLfloat delta_time;		/** Frame time passed to BLZ_SetFrameTime */
+};
+
 /**
  * OpenGL function loader signature.
  * @see BLZ_Load
  */
 typedef void* (*glGetProcAddress)(const char *name);
 
+/**
+ * Memory allocation function signature.
+ * @see BLZ_SetAllocator
+ */
+typedef void *(*BLZ_AllocFunc)(size_t size, void *user_data);
+/**
+ * Memory reallocation function signature.
+ * @see BLZ_SetAllocator
+ */
+typedef void *(*BLZ_ReallocFunc)(void *ptr, size_t size, void *user_data);
+/**
+ * Memory freeing function signature.
+ * @see BLZ_SetAllocator
+ */
+typedef void (*BLZ_FreeFunc)(void *ptr, void *user_data);
+
+/**
+ * Defines categories for the library memory usage counters.
+ * @see BLZ_GetMemoryUsage
+ */
+enum BLZ_MemoryCategory
+{
+	/** Short-lived buffers like index data and shader logs */
+	MEMORY_TEMPORARY = 0,
+	/** Batch objects and their bucket data */
+	MEMORY_BATCHES,
+	/** Sprite vertex data */
+	MEMORY_VERTICES,
+	/** Shader objects */
+	MEMORY_SHADERS,
+	/** Texture objects */
+	MEMORY_TEXTURES,
+	/** Render target objects */
+	MEMORY_RENDER_TARGETS,
+	/* \cond */
+	MEMORY_CATEGORY_COUNT
+	/* \endcond */
+};
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -194,12 +350,15 @@ extern "C"
 	* Loads the OpenGL functions using the specified loader and initializes the library.
 	* @param loader OpenGL function loader which accepts an 'const char *name'.
 	* If you're using SDL, pass SDL_GL_GetProcAddress as the value.
+	* Can be called again for a new context, the sprites which are not drawn
+	* yet by \ref IMMEDIATE_COALESCE mode are dropped then.
 	* @return Non-zero on success, zero on failure
 	*/
 	extern BLZAPIENTRY int BLZAPICALL BLZ_Load(glGetProcAddress loader);
 	/**
 	 * Sets the viewport size in pixels.
-	 * Used in sprite position calculations.
+	 * Used in sprite position calculations, the OpenGL viewport is left
+	 * to the caller.
 	 */
 	extern BLZAPIENTRY int BLZAPICALL BLZ_SetViewport(int w, int h);
 	/**
@@ -227,6 +386,69 @@ extern "C"
 	 * @see BLZ_DrawImmediate
 	 */
 	extern BLZAPIENTRY void BLZAPICALL BLZ_SetBlendMode(const struct BLZ_BlendFunc func);
+	/**
+	 * Enables or disables the premultiplied alpha mode. When enabled, the
+	 * blend mode is set to \ref BLEND_PREMULTIPLIED and every texture which
+	 * is loaded afterwards gets the MULTIPLY_ALPHA flag. Sprite colors should
+	 * be converted with \ref BLZ_PremultiplyColor, which allows additive and
+	 * normally blended sprites to share a single draw call.
+	 * Disabling the mode restores \ref BLEND_NORMAL. Textures that are
+	 * already loaded are not affected.
+	 * @param enabled Non-zero to enable the mode, zero to disable it
+	 * @see BLZ_PremultiplyColor
+	 */
+	extern BLZAPIENTRY void BLZAPICALL BLZ_SetPremultipliedAlpha(int enabled);
+	/**
+	 * Converts a straight alpha color to the premultiplied one.
+	 * The additive factor scales the resulting alpha down - 0 gives the
+	 * normal alpha blending, 1 gives the additive blending, values in between
+	 * mix both of them.
+	 * @param color Color with straight alpha
+	 * @param additive Additive factor, clamped to [0, 1] range
+	 * @see BLZ_SetPremultipliedAlpha
+	 */
+	extern BLZAPIENTRY struct BLZ_Vector4 BLZAPICALL BLZ_PremultiplyColor(
+		struct BLZ_Vector4 color, float additive);
+	/**
+	 * Sets the functions which are used for every memory allocation made by
+	 * the library. Must be called when no library memory is in use, before
+	 * \ref BLZ_Load, for example. The image decoding buffers of SOIL are
+	 * allocated by these functions too and are counted as MEMORY_TEXTURES.
+	 * Always fails with BLZ_CONFIG_STATIC, where SOIL uses the C library
+	 * allocator.
+	 * @param alloc Allocation function, or NULL to restore the default one
+	 * @param realloc Reallocation function, or NULL to restore the default one
+	 * @param free Freeing function, or NULL to restore the default one
+	 * @param user_data Pointer which is passed to the functions
+	 * @see BLZ_GetMemoryUsage
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SetAllocator(
+		BLZ_AllocFunc alloc,
+		BLZ_ReallocFunc realloc,
+		BLZ_FreeFunc free,
+		void *user_data);
+	/**
+	 * Returns the count of bytes currently allocated by the library for the
+	 * specified category.
+	 * @see BLZ_SetAllocator
+	 */
+	extern BLZAPIENTRY size_t BLZAPICALL BLZ_GetMemoryUsage(
+		enum BLZ_MemoryCategory category);
+	/**
+	 * Frees the unused pages of the vertex page pool. Dynamic batches borrow
+	 * fixed-size vertex pages from a pool shared between all batches and
+	 * return them on \ref BLZ_Present, the pool keeps them for reuse until
+	 * this function is called.
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_TrimVertexPool();
+	/**
+	 * Tells the library that the OpenGL state was changed outside of it.
+	 * The library keeps a copy of the state it sets (bound textures, vertex
+	 * arrays, array buffer, shader program, blend function, framebuffer and
+	 * uniform values) and skips the calls which wouldn't change it. Call this function after making your own OpenGL calls which change
+	 * that state, before using the library again.
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_InvalidateGLState();
 	/** @} */
 
 	/** \addtogroup dynamic Dynamic drawing
@@ -252,11 +474,33 @@ extern "C"
 		* Disables sprite vertex array buffering, which lowers GPU memory usage, but
   		* sacrifices sprite drawing speed.
   		*/
-		NO_BUFFERING = 1
+		NO_BUFFERING = 1,
+		/**
+		 * Draws the sprites as opaque ones with depth testing, so the covered
+		 * pixels are not shaded. Every sprite gets its own depth, the later
+		 * drawn ones are closer, and the batch is drawn front-to-back without
+		 * blending. The default shader is replaced by its variant which
+		 * discards the pixels with alpha below 0.5, a custom vertex shader
+		 * should use 'float in_Depth' attribute as Z coordinate. Draw the
+		 * translucent sprites with another batch after this one. The depth
+		 * test is disabled after the batch is drawn, so the translucent
+		 * sprites are blended over all of the opaque ones, even the ones
+		 * which should be in front of them. Every present of an opaque batch
+		 * gets its own slice of the depth range, the later presents are
+		 * closer, so the presents keep the painter's order of the blended
+		 * sprites. BLZ_Clear restarts the slices, see BLZ_DEPTH_SLICES in
+		 * blaze_config.h. Requires a depth buffer, the render targets always
+		 * have one. The batch can't be recorded by a render queue.
+		 */
+		OPAQUE_SPRITES = 2
 	};
 
 	/**
 	 * Creates a new dynamic batch using the specified parameters.
+	 * The buckets allocate their memory and GPU buffers when they are used for
+	 * the first time, see \ref BLZ_TrimBatch to release the unused ones.
+	 * With BLZ_CONFIG_STATIC the limits must not exceed BLZ_MAX_BUCKETS and
+	 * BLZ_MAX_SPRITES_PER_BUCKET, which only size the storage of a batch.
 	 * @param max_buckets Defines maximum sprite buckets. A bucket uses same
 	 * texture for all sprites and is limited by max_sprites_per_batch.
 	 * @param max_sprites_per_bucket Defines maximum sprite count in one bucket.
@@ -271,6 +515,43 @@ extern "C"
 		int max_sprites_per_bucket,
 		enum BLZ_InitFlags flags);
 
+	/**
+	 * Defines the data type of custom vertex channels.
+	 * @see BLZ_CreateBatchEx
+	 */
+	enum BLZ_ChannelFormat
+	{
+		/** Four floats per channel */
+		CHANNEL_FLOAT = 0,
+		/**
+		 * Four unsigned bytes per channel, the values are clamped to 0..1
+		 * range and normalized back to it in the shader
+		 */
+		CHANNEL_UBYTE = 1
+	};
+
+	/**
+	 * Creates a new dynamic batch with custom vertex channels, which pass
+	 * per-sprite parameters to the shader without breaking the batch.
+	 * Channel N is bound to 'vec4 in_ChannelN' vertex shader attribute
+	 * (location 3 + N) and is set by \ref BLZ_DrawEx. Batches with channels
+	 * can't be recorded by a render queue.
+	 * With BLZ_CONFIG_STATIC the channel count must not exceed
+	 * BLZ_MAX_CHANNELS.
+	 * @param max_buckets Same as in \ref BLZ_CreateBatch
+	 * @param max_sprites_per_bucket Same as in \ref BLZ_CreateBatch
+	 * @param flags Same as in \ref BLZ_CreateBatch
+	 * @param channel_count Count of channels, from 0 to 4
+	 * @param channel_format Data type of the channels
+	 * @see BLZ_DrawEx
+	 */
+	extern BLZAPIENTRY struct BLZ_SpriteBatch *BLZAPICALL BLZ_CreateBatchEx(
+		int max_buckets,
+		int max_sprites_per_bucket,
+		enum BLZ_InitFlags flags,
+		int channel_count,
+		enum BLZ_ChannelFormat channel_format);
+
 	/**
 	 * Reads options specified in \ref BLZ_CreateBatch for the specified batch object.
 	 * @see BLZ_CreateBatch
@@ -287,6 +568,19 @@ extern "C"
 	 */
 	extern BLZAPIENTRY int BLZAPICALL BLZ_FreeBatch(struct BLZ_SpriteBatch *batch);
 
+	/**
+	 * Releases memory and GPU buffers of the batch's buckets which were not
+	 * used for the specified count of \ref BLZ_Present calls. The released
+	 * buckets are allocated again when they are needed.
+	 * @param batch The batch to trim
+	 * @param idle_frames Minimal count of presents the bucket wasn't used in,
+	 * pass 0 to release every currently empty bucket
+	 * @see BLZ_CreateBatch
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_TrimBatch(
+		struct BLZ_SpriteBatch *batch,
+		int idle_frames);
+
 	/**
 	 * Adds a sprite to specified batch using specified parameters.
 	 * @param batch The batch to put the sprite in
@@ -315,6 +609,31 @@ extern "C"
 		const struct BLZ_Vector4 color,
 		enum BLZ_SpriteFlip effects);
 
+	/**
+	 * Adds a sprite to specified batch using a precomputed sprite definition.
+	 * Produces the same geometry as \ref BLZ_Draw called with the definition's
+	 * texture, source rectangle and origin, but skips the texture coordinate
+	 * calculations.
+	 * @param batch The batch to put the sprite in
+	 * @param def Sprite definition, see \ref BLZ_InitSpriteDef
+	 * @param position Position of the sprite's origin point
+	 * @param rotation Rotation of the sprite in clockwise direction in radians
+	 * @param scale Scale in X and Y directions, if NULL, defaults to (1,1)
+	 * @param color Color to apply to the sprite (color gets multiplied if
+	 * default shader is used)
+	 * @param effects Defines if the sprite should be flipped in any direction
+	 * @see BLZ_InitSpriteDef
+	 * @see BLZ_Present
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawDef(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_SpriteDef *def,
+		const struct BLZ_Vector2 position,
+		float rotation,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
 	/**
 	 * Lower level dynamic batching function, called by \ref BLZ_Draw. You can
 	 * pass your own quad (fullscreen one, for example).
@@ -325,6 +644,102 @@ extern "C"
 		GLuint texture,
 		const struct BLZ_SpriteQuad *quad);
 
+	/**
+	 * Initializes a material with the specified shader and blend function and
+	 * no additional textures.
+	 * @param material The material to initialize
+	 * @param shader Shader program, NULL for the default one
+	 * @param blend Blend function
+	 * @see BLZ_DrawMaterial
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_InitMaterial(
+		struct BLZ_Material *material,
+		struct BLZ_Shader *shader,
+		const struct BLZ_BlendFunc blend);
+
+	/**
+	 * Same as \ref BLZ_Draw, but the sprite is drawn using the specified
+	 * material instead of the current shader and blend mode. The material is
+	 * read when this function is called, so it can be changed afterwards.
+	 * Sprites of the same material are drawn together, the groups go in
+	 * the order in which their materials were used for the first time.
+	 * The texture slots changed by a material are restored after the batch
+	 * is presented.
+	 * @param batch The batch to put the sprite in
+	 * @param material Material of the sprite, if NULL, the current state is
+	 * used like in \ref BLZ_Draw
+	 * @see BLZ_Draw
+	 * @see BLZ_InitMaterial
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawMaterial(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Material *material,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Vector2 position,
+		const struct BLZ_Rectangle *srcRectangle,
+		float rotation,
+		const struct BLZ_Vector2 *origin,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
+	/**
+	 * Same as \ref BLZ_DrawDef, but uses the specified material.
+	 * @see BLZ_DrawMaterial
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawDefMaterial(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Material *material,
+		const struct BLZ_SpriteDef *def,
+		const struct BLZ_Vector2 position,
+		float rotation,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
+	/**
+	 * Same as \ref BLZ_LowerDraw, but uses the specified material.
+	 * @see BLZ_DrawMaterial
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerDrawMaterial(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Material *material,
+		GLuint texture,
+		const struct BLZ_SpriteQuad *quad);
+
+	/**
+	 * Same as \ref BLZ_DrawMaterial, but also sets the custom vertex channels
+	 * of the sprite.
+	 * @param channels Four values for each channel of the batch, the same
+	 * values are set for every vertex of the sprite. If NULL, the channels
+	 * are set to zero. Ignored if the batch has no channels.
+	 * @see BLZ_CreateBatchEx
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawEx(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Material *material,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Vector2 position,
+		const struct BLZ_Rectangle *srcRectangle,
+		float rotation,
+		const struct BLZ_Vector2 *origin,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects,
+		const GLfloat *channels);
+
+	/**
+	 * Same as \ref BLZ_LowerDrawMaterial, but also sets the custom vertex
+	 * channels of the sprite.
+	 * @see BLZ_DrawEx
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerDrawEx(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Material *material,
+		GLuint texture,
+		const struct BLZ_SpriteQuad *quad,
+		const GLfloat *channels);
+
 	/**
 	 * Draws everything from the specified dynamic batch to screen.
 	 */
@@ -335,22 +750,50 @@ extern "C"
 	 * Static batched sprite drawing.
 	 * Use it when you want to efficiently draw static things like tilemaps.
 	 * On the first \ref BLZ_PresentStatic call, the sprite data will be 'baked'
-	 * into GPU memory and then become non-modifiable.
+	 * into GPU memory. Afterwards the sprites can be replaced, hidden or
+	 * appended, only the changed ones are uploaded on the next present.
 	 * If you want to draw a small number of different sprites which will not
 	 * benefit of batching (grouping) them, see \ref immediate module.
 	 * If you want to efficiently draw changing geometry,
 	 * see the \ref dynamic module.
 	 * @{
 	 */
+	/**
+	 * Defines options of the static batches.
+	 * @see BLZ_CreateStaticEx
+	 */
+	enum BLZ_StaticFlags
+	{
+		/** Default flags */
+		STATIC_DEFAULT = 0,
+		/**
+		 * Frees the system memory copy of the sprites after the upload, the
+		 * later changes are uploaded immediately. Has no effect with
+		 * BLZ_CONFIG_STATIC, where the memory belongs to the static pool.
+		 */
+		DISCARD_CPU_COPY = 1,
+		/**
+		 * Stores the vertices in GPU memory using 12 bytes instead of 32:
+		 * positions are rounded to 16-bit integers (-32768 to 32767), texture
+		 * coordinates are 16-bit and colors are 8-bit normalized values. Fits
+		 * the pixel aligned sprites like tilemaps, the rotated sprites lose
+		 * their subpixel precision.
+		 */
+		QUANTIZED = 2
+	};
+
 	/**
 	 * Creates a 'static' batch object. The difference from the dynamic one is
 	 * that when this batch is drawn for the first time, the sprites will be
-	 * 'baked' into vertex array and cannot be modified. It's useful for static
+	 * 'baked' into vertex array and are modified only on request. It's useful for static
 	 * level geometry like tilemaps, because individual tile positions shouldn't
 	 * be calculated each frame, but they should be transformed as a whole
 	 * (by camera, for example). In other words, it lowers CPU usage.
-	 * @param texture Texture which will be used to draw the sprites
-	 * @param max_sprite_count Maximum count of sprites which can be stored
+	 * @param texture Texture which will be used to draw the sprites, sprites
+	 * with other textures can be added by \ref BLZ_DrawStaticTexture. Can be
+	 * NULL if only that function is used.
+	 * @param max_sprite_count Maximum count of sprites which can be stored,
+	 * must not exceed BLZ_MAX_STATIC_SPRITES with BLZ_CONFIG_STATIC
 	 * @see BLZ_DrawStatic
 	 * @see BLZ_FreeStatic
 	 * @see BLZ_GetOptionsStatic
@@ -358,6 +801,30 @@ extern "C"
 	extern BLZAPIENTRY struct BLZ_StaticBatch BLZAPICALL *BLZ_CreateStatic(
 		const struct BLZ_Texture *texture, int max_sprite_count);
 
+	/**
+	 * Creates a static batch with storage options, which optionally splits the
+	 * sprites into square grid cells when they are uploaded. \ref BLZ_PresentStatic culls the cells against
+	 * the viewport using the transformation matrix and draws only the visible
+	 * ones, which is useful for the maps larger than the screen. The sprites
+	 * are drawn cell by cell, so the order of overlapping sprites from
+	 * different cells is not preserved.
+	 * @param texture Texture which will be used to draw the sprites
+	 * @param max_sprite_count Maximum count of sprites which can be stored,
+	 * must not exceed BLZ_MAX_STATIC_SPRITES with BLZ_CONFIG_STATIC
+	 * @param cell_size Size of the cell in pixels, a few cells per screen keep
+	 * both the culling precision and the count of drawn ranges reasonable.
+	 * Pass 0 to disable culling, same as \ref BLZ_CreateStatic.
+	 * With BLZ_CONFIG_STATIC the count of non-empty cells must not exceed
+	 * BLZ_MAX_STATIC_CELLS.
+	 * @param flags Storage options of the batch
+	 * @see BLZ_CreateStatic
+	 */
+	extern BLZAPIENTRY struct BLZ_StaticBatch BLZAPICALL *BLZ_CreateStaticEx(
+		const struct BLZ_Texture *texture,
+		int max_sprite_count,
+		float cell_size,
+		enum BLZ_StaticFlags flags);
+
 	/**
 	 * Reads options specified in \ref BLZ_CreateStatic for the specified static
 	 * batch object.
@@ -400,6 +867,22 @@ extern "C"
 		const struct BLZ_Vector4 color,
 		enum BLZ_SpriteFlip effects);
 
+	/**
+	 * Adds a sprite to specified static batch using a precomputed sprite
+	 * definition. The sprite uses the texture of the definition, see
+	 * \ref BLZ_DrawStaticTexture.
+	 * @see BLZ_DrawDef
+	 * @see BLZ_InitSpriteDef
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawStaticDef(
+		struct BLZ_StaticBatch *batch,
+		const struct BLZ_SpriteDef *def,
+		const struct BLZ_Vector2 position,
+		float rotation,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
 	/**
 	 * Lower level static batching function, called by \ref BLZ_DrawStatic. You can
 	 * pass your own quad (fullscreen one, for example).
@@ -409,10 +892,87 @@ extern "C"
 		struct BLZ_StaticBatch *batch,
 		const struct BLZ_SpriteQuad *quad);
 
+	/**
+	 * Adds a sprite with the specified texture to the static batch, the
+	 * other parameters are the same as in \ref BLZ_DrawStatic. When the batch
+	 * is uploaded, the sprites are grouped by their textures in order of the
+	 * first use of each texture, so a texture is bound once per present.
+	 * Overlapping sprites with different textures are drawn in that order
+	 * rather than in the order they were added.
+	 * @see BLZ_DrawStatic
+	 * @see BLZ_LowerDrawStaticTexture
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawStaticTexture(
+		struct BLZ_StaticBatch *batch,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Vector2 position,
+		const struct BLZ_Rectangle *srcRectangle,
+		float rotation,
+		const struct BLZ_Vector2 *origin,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
+	/**
+	 * Lower level function of \ref BLZ_DrawStaticTexture which adds your
+	 * own quad with the specified texture.
+	 * @see BLZ_DrawStaticTexture
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerDrawStaticTexture(
+		struct BLZ_StaticBatch *batch,
+		GLuint texture,
+		const struct BLZ_SpriteQuad *quad);
+
+	/**
+	 * Replaces a sprite of the static batch, the parameters are the same as
+	 * in \ref BLZ_DrawStaticTexture. The sprite keeps its texture and place
+	 * in the drawing order. If the batch was already presented, only the
+	 * changed sprites are uploaded on the next \ref BLZ_PresentStatic call.
+	 * The sprites can be appended after the upload too, using the usual
+	 * functions.
+	 * @param batch The batch which contains the sprite
+	 * @param index Index of the sprite in the order of adding, starting at 0
+	 * @param texture Texture of the sprite, must be the one it was added with
+	 * @see BLZ_LowerReplaceStatic
+	 * @see BLZ_HideStatic
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_ReplaceStatic(
+		struct BLZ_StaticBatch *batch,
+		int index,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Vector2 position,
+		const struct BLZ_Rectangle *srcRectangle,
+		float rotation,
+		const struct BLZ_Vector2 *origin,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+
+	/**
+	 * Lower level function of \ref BLZ_ReplaceStatic which sets your own
+	 * quad.
+	 * @see BLZ_ReplaceStatic
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerReplaceStatic(
+		struct BLZ_StaticBatch *batch,
+		int index,
+		const struct BLZ_SpriteQuad *quad);
+
+	/**
+	 * Hides a sprite of the static batch by collapsing its quad. Use
+	 * \ref BLZ_ReplaceStatic to show it again.
+	 * @param batch The batch which contains the sprite
+	 * @param index Index of the sprite in the order of adding, starting at 0
+	 * @see BLZ_ReplaceStatic
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_HideStatic(
+		struct BLZ_StaticBatch *batch,
+		int index);
+
 	/**
 	 * Draws everything from the specified static batch to screen. If it's
 	 * the first time when the batch is drawn, 'bakes' the sprites into GPU
-	 * memory and forbids modification.
+	 * memory, otherwise uploads the sprites changed since the last call.
 	 * @param batch The static batch to draw
 	 * @param transformMatrix4x4 The transformation matrix. If NULL, identity
 	 * matrix is used (so the sprites will be drawn as specified by
@@ -422,6 +982,50 @@ extern "C"
 	extern BLZAPIENTRY int BLZAPICALL BLZ_PresentStatic(
 		struct BLZ_StaticBatch *batch,
 		const GLfloat *transformMatrix4x4);
+
+	/**
+	 * Saves the baked sprites of the static batch to a file, so they can be
+	 * loaded by \ref BLZ_LoadStatic without building them again. Uploads the
+	 * batch first if it's not presented yet. The file stores the vertices in
+	 * the layout of the GPU buffer and uses the native byte order.
+	 * The textures are stored by the order of their first use in the batch.
+	 * @param batch The static batch to save
+	 * @param path Path of the file which will be created or replaced
+	 * @see BLZ_LoadStatic
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SaveStatic(
+		struct BLZ_StaticBatch *batch,
+		const char *path);
+
+	/**
+	 * Creates a static batch from the file written by \ref BLZ_SaveStatic.
+	 * The vertices are read directly into the GPU buffer, the batch is ready
+	 * to be presented and can be changed as usual afterwards.
+	 * The options of the saved batch are restored.
+	 * @param path Path of the file
+	 * @param texture Texture of the sprites
+	 * @returns Static batch or NULL if the file is invalid
+	 * @see BLZ_LoadStaticEx
+	 */
+	extern BLZAPIENTRY struct BLZ_StaticBatch BLZAPICALL *BLZ_LoadStatic(
+		const char *path,
+		const struct BLZ_Texture *texture);
+
+	/**
+	 * Creates a static batch with several textures from the file written by
+	 * \ref BLZ_SaveStatic.
+	 * @param path Path of the file
+	 * @param textures Textures of the sprites in the order of their first use
+	 * in the saved batch
+	 * @param texture_count Count of the textures, must not be less than the
+	 * count of textures used by the saved batch
+	 * @returns Static batch or NULL if the file is invalid
+	 * @see BLZ_LoadStatic
+	 */
+	extern BLZAPIENTRY struct BLZ_StaticBatch BLZAPICALL *BLZ_LoadStaticEx(
+		const char *path,
+		const struct BLZ_Texture **textures,
+		int texture_count);
 	/** @} */
 
 	/** \addtogroup immediate Immediate drawing
@@ -462,6 +1066,105 @@ extern "C"
 	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerDrawImmediate(
 		GLuint texture,
 		const struct BLZ_SpriteQuad *quad);
+
+	/**
+	 * Defines how the immediate drawing functions submit the sprites.
+	 * @see BLZ_SetImmediateMode
+	 */
+	enum BLZ_ImmediateMode
+	{
+		/** Every sprite is drawn by a separate draw call (default) */
+		IMMEDIATE_DIRECT = 0,
+		/**
+		 * Consecutive sprites which use the same texture are accumulated and
+		 * drawn by one draw call through a ring-buffered vertex buffer.
+		 * The accumulated sprites are drawn when the texture changes, when
+		 * the library state changes (shader, uniforms, blend mode, render
+		 * target, viewport, texture options), on other drawing calls,
+		 * \ref BLZ_Clear and \ref BLZ_SaveScreenshot, or when
+		 * \ref BLZ_FlushImmediate is called. Call \ref BLZ_FlushImmediate
+		 * before swapping the window buffers or doing your own OpenGL calls.
+		 */
+		IMMEDIATE_COALESCE = 1
+	};
+
+	/**
+	 * Sets the immediate drawing mode. Switching to
+	 * \ref IMMEDIATE_DIRECT draws the accumulated sprites.
+	 * @see BLZ_ImmediateMode
+	 * @see BLZ_FlushImmediate
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SetImmediateMode(
+		enum BLZ_ImmediateMode mode);
+
+	/**
+	 * Draws the sprites accumulated by the immediate drawing functions in
+	 * \ref IMMEDIATE_COALESCE mode. Does nothing in the default mode.
+	 * @see BLZ_SetImmediateMode
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_FlushImmediate();
+	/** @} */
+
+	/** \addtogroup queue Render queue
+	 * Records the presents of dynamic and static batches, immediate draws and
+	 * clears between \ref BLZ_BeginQueue and \ref BLZ_EndQueue, and then
+	 * executes them sorted by their state to minimize the state changes.
+	 * The execution order is: render targets in order of their first use,
+	 * clears of the target, then layers in ascending order. Inside a layer
+	 * the draws are grouped by shader, blend mode and texture, so the sprites
+	 * which should overlap in a specific order must be put into different
+	 * layers. Uniform values, additional texture slots and OpenGL calls made
+	 * outside of the library are not recorded.
+	 *
+	 * Sorting by the first use of the targets changes the draw order
+	 * compared to drawing without the queue: all of the commands of a
+	 * target are executed together, including the ones recorded after
+	 * switching to another target and back. A render target which is
+	 * sampled by the draws into another target must be used before that
+	 * target, otherwise its texture is read before it's drawn into.
+	 * @{
+	 */
+	/**
+	 * Creates a render queue.
+	 * @param max_commands Maximum count of recorded commands per frame. Every
+	 * texture bucket of a presented dynamic batch, static batch present and
+	 * clear is a command, consecutive immediate draws with the same state
+	 * share one command.
+	 * @param max_sprites Maximum count of dynamic and immediate sprites
+	 * per frame, up to 16384
+	 * @see BLZ_FreeRenderQueue
+	 */
+	extern BLZAPIENTRY struct BLZ_RenderQueue *BLZAPICALL BLZ_CreateRenderQueue(
+		int max_commands,
+		int max_sprites);
+
+	/**
+	 * Frees the render queue and the associated resources.
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_FreeRenderQueue(
+		struct BLZ_RenderQueue *queue);
+
+	/**
+	 * Starts recording into the specified queue. Only one queue can be
+	 * recorded at once. The layer is reset to 0.
+	 * @see BLZ_EndQueue
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_BeginQueue(
+		struct BLZ_RenderQueue *queue);
+
+	/**
+	 * Stops recording and executes the recorded commands. The shaders,
+	 * textures and batches used by the commands must be alive until then.
+	 * @see BLZ_BeginQueue
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_EndQueue(
+		struct BLZ_RenderQueue *queue);
+
+	/**
+	 * Sets the layer for the subsequently recorded commands. Lower layers are
+	 * drawn first.
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SetLayer(int layer);
 	/** @} */
 
 	/** \addtogroup texture Textures
@@ -525,6 +1228,99 @@ extern "C"
 
 	/** @} */
 
+	/** \addtogroup spritedef Sprite definitions
+	 * Precomputed sprite definitions. Useful when the same part of a texture
+	 * (a texture atlas frame, for example) is drawn many times.
+	 * @{
+	 */
+	/**
+	 * Initializes the sprite definition for the specified texture region.
+	 * @param def Sprite definition to fill
+	 * @param texture Sprite texture
+	 * @param srcRectangle Part of the source texture to draw defined in pixels,
+	 * or NULL if the whole texture should be drawn. For the textures loaded
+	 * with TRIM_ALPHA flag it refers to the trimmed image.
+	 * @param origin The point around which the sprite should be positioned and
+	 * rotated, if NULL, top-left corner (0, 0) will be used
+	 * @see BLZ_DrawDef
+	 * @see BLZ_DrawStaticDef
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_InitSpriteDef(
+		struct BLZ_SpriteDef *def,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Rectangle *srcRectangle,
+		const struct BLZ_Vector2 *origin);
+	/** @} */
+
+	/** \addtogroup mesh Sprite meshes
+	 * Convex polygons which are drawn instead of the sprite rectangles to
+	 * skip the fully transparent parts.
+	 * @{
+	 */
+	/**
+	 * Builds a convex polygon which covers every texel of the region with
+	 * alpha above the threshold. The polygon edges are horizontal, vertical
+	 * or diagonal, so 8 vertices give an octagon and 4 give the bounding box.
+	 * @param mesh Mesh to fill
+	 * @param pixels Image data, 4 bytes (RGBA) per pixel without row padding
+	 * @param width Image width in pixels
+	 * @param height Image height in pixels
+	 * @param region Part of the image in pixels, or NULL for the whole image
+	 * @param max_vertices Maximum count of the polygon vertices, 4 to 8
+	 * @param alpha_threshold Texels with alpha up to this value are skipped
+	 * @see BLZ_BuildTextureMesh
+	 * @see BLZ_DrawMesh
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_BuildSpriteMesh(
+		struct BLZ_SpriteMesh *mesh,
+		const unsigned char *pixels,
+		int width,
+		int height,
+		const struct BLZ_Rectangle *region,
+		int max_vertices,
+		unsigned char alpha_threshold);
+	/**
+	 * Builds the mesh from the texture data, which is read back from the GPU.
+	 * Always fails with BLZ_CONFIG_STATIC.
+	 * @see BLZ_BuildSpriteMesh
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_BuildTextureMesh(
+		struct BLZ_SpriteMesh *mesh,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_Rectangle *region,
+		int max_vertices,
+		unsigned char alpha_threshold);
+	/**
+	 * Draws the sprite as the specified mesh into the batch. The parameters
+	 * are the same as in \ref BLZ_Draw. The mesh takes a sprite of the
+	 * batch capacity per two vertices beyond the first two, an octagon takes
+	 * three.
+	 * @see BLZ_Draw
+	 * @see BLZ_BuildSpriteMesh
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_DrawMesh(
+		struct BLZ_SpriteBatch *batch,
+		const struct BLZ_Texture *texture,
+		const struct BLZ_SpriteMesh *mesh,
+		const struct BLZ_Vector2 position,
+		const struct BLZ_Rectangle *srcRectangle,
+		float rotation,
+		const struct BLZ_Vector2 *origin,
+		const struct BLZ_Vector2 *scale,
+		const struct BLZ_Vector4 color,
+		enum BLZ_SpriteFlip effects);
+	/**
+	 * Draws the mesh mapped to the specified sprite quad, which should be
+	 * a parallelogram.
+	 * @see BLZ_DrawMesh
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_LowerDrawMesh(
+		struct BLZ_SpriteBatch *batch,
+		GLuint texture,
+		const struct BLZ_SpriteMesh *mesh,
+		const struct BLZ_SpriteQuad *quad);
+	/** @} */
+
 	/** \addtogroup rendertarget Render targets
 	 * Render targets.
 	 * Allows rendering to texture and using it later for some other purpose
@@ -541,10 +1337,15 @@ extern "C"
 		GLuint id;
 		/** Underlying texture */
 		struct BLZ_Texture texture;
+		/** OpenGL renderbuffer ID of the depth buffer */
+		GLuint depth;
+		/** Depth range slice of the next opaque present, see OPAQUE_SPRITES */
+		int depth_slice;
 	};
 
 	/**
-	 * Creates a RGBA render target using specified parameters.
+	 * Creates a RGBA render target using specified parameters. The target has
+	 * a 24-bit depth buffer too, so the opaque batches can be drawn into it.
 	 */
 	extern BLZAPIENTRY struct BLZ_RenderTarget *BLZAPICALL BLZ_CreateRenderTarget(
 		int width, int height);
@@ -574,6 +1375,93 @@ extern "C"
 	extern BLZAPIENTRY struct BLZ_Shader *BLZAPICALL BLZ_CompileShader(
 		const char *vert, const char *frag);
 
+	/**
+	 * Defines the compilation state of a shader program.
+	 * @see BLZ_PollShader
+	 */
+	enum BLZ_ShaderStatus
+	{
+		/** The program is still being compiled */
+		SHADER_PENDING = 0,
+		/** The program is compiled and linked */
+		SHADER_READY = 1,
+		/** The compilation or linking has failed, the log is printed */
+		SHADER_FAILED = 2
+	};
+
+	/**
+	 * Starts the compilation of a shader program and returns it in the
+	 * pending state without waiting for the driver. With
+	 * GL_KHR_parallel_shader_compile several programs are compiled at once.
+	 * The result is checked by \ref BLZ_PollShader or when the shader is
+	 * used for the first time. A failed shader should be freed.
+	 * @param vert Vertex shader source string
+	 * @param frag Fragment shader source string
+	 * @see BLZ_PollShader
+	 */
+	extern BLZAPIENTRY struct BLZ_Shader *BLZAPICALL BLZ_CompileShaderAsync(
+		const char *vert, const char *frag);
+	/**
+	 * Returns the compilation state of the shader program. Doesn't block if
+	 * the driver supports GL_KHR_parallel_shader_compile, otherwise waits
+	 * for the compilation to complete.
+	 * @see BLZ_CompileShaderAsync
+	 */
+	extern BLZAPIENTRY enum BLZ_ShaderStatus BLZAPICALL BLZ_PollShader(
+		struct BLZ_Shader *shader);
+
+	/**
+	 * Sets the directory of the program binary cache. When it's set, the
+	 * linked programs are saved there and \ref BLZ_CompileShader loads them
+	 * instead of compiling the sources again. The binaries are keyed by the
+	 * source hash and the driver vendor, renderer and version strings, a
+	 * second independent source hash is checked before a binary is loaded.
+	 * The ones which are rejected by the driver are compiled from the
+	 * sources and replaced. Can be called before \ref BLZ_Load to cache the default
+	 * shader too. Requires OpenGL 4.1 or GL_ARB_get_program_binary, the
+	 * cache is ignored otherwise.
+	 * @param path Existing directory, or NULL to disable the cache
+	 * @see BLZ_WarmUpShaderCache
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SetShaderCacheDir(const char *path);
+	/**
+	 * Preloads every program for the current driver from the binary cache,
+	 * so the following \ref BLZ_CompileShader calls with the same sources
+	 * don't touch the disk. Fails if the cache is not set or not supported.
+	 * @see BLZ_SetShaderCacheDir
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_WarmUpShaderCache();
+
+	/**
+	 * Compiles a variant of the shader program with the specified
+	 * preprocessor defines, which are inserted right after the #version line.
+	 * The variants are cached by the sources and the set of defines, so
+	 * compiling the same variant again returns the same shader with an
+	 * increased reference count. Every call should be paired with
+	 * \ref BLZ_FreeShader.
+	 * @param vert Vertex shader source string
+	 * @param frag Fragment shader source string
+	 * @param defines NULL-terminated array of up to 16 defines, each is
+	 * either a name ("GRAYSCALE") or a name with value ("LEVELS 4"), or NULL.
+	 * With BLZ_CONFIG_STATIC their total length including the terminating
+	 * zeros must not exceed BLZ_VARIANT_DEFINES_SIZE.
+	 * @see BLZ_GetDefaultShaderVariant
+	 */
+	extern BLZAPIENTRY struct BLZ_Shader *BLZAPICALL BLZ_CompileShaderVariant(
+		const char *vert, const char *frag, const char *const *defines);
+	/**
+	 * Returns a variant of the default shader program. The following defines
+	 * are supported:
+	 * - "BLZ_ALPHA_TEST value" discards the pixels with alpha below the value
+	 * - "BLZ_GRAYSCALE" converts the output color to grayscale
+	 *
+	 * NULL or empty defines give the default shader itself.
+	 * @param defines NULL-terminated array of defines, or NULL
+	 * @see BLZ_CompileShaderVariant
+	 */
+	extern BLZAPIENTRY struct BLZ_Shader *BLZAPICALL BLZ_GetDefaultShaderVariant(
+		const char *const *defines);
+
 	/**
 	 * Sets the specified shader as the current.
 	 */
@@ -592,11 +1480,17 @@ extern "C"
 
 	/** \addtogroup shader_params Shader parameters
 	 * Shader parameters (uniforms) querying and setting. Identical to
-	 * glGetUniformLocation and glUniformXXX OpenGL calls.
+	 * glGetUniformLocation and glUniformXXX OpenGL calls, but the library
+	 * keeps a copy of the values set for the current shader program and skips
+	 * the uploads which wouldn't change anything. If you set the uniforms with
+	 * glUniformXXX directly, call \ref BLZ_InvalidateGLState afterwards.
 	 * @{
 	 */
 	/**
-	 * Returns the uniform location for the specified shader program.
+	 * Returns the uniform location for the specified shader program. The
+	 * locations of active uniforms are cached when the program is linked, so
+	 * this function doesn't query the driver for them. A pending shader
+	 * waits for the compilation to complete, -1 is returned if it failed.
 	 */
 	extern BLZAPIENTRY GLint BLZAPICALL BLZ_GetUniformLocation(
 		const struct BLZ_Shader *shader,
@@ -703,6 +1597,61 @@ extern "C"
 
 	/** @} */
 
+	/** \addtogroup uniform_buffers Uniform buffers
+	 * Uniform blocks which are shared by all shaders, so their values are
+	 * uploaded once instead of after every shader switch. Binding point 0 is
+	 * used by the built-in \ref BLZ_FrameData block, up to
+	 * BLZ_MAX_UNIFORM_BUFFERS user buffers can exist at once. Uniform buffers
+	 * require OpenGL 3.1 or the ARB_uniform_buffer_object extension.
+	 * @{
+	 */
+	/**
+	 * Sets the time values of \ref BLZ_FrameData, call it once per frame.
+	 * @param time Time in seconds, for example, since the start of the app
+	 * @param delta_time Time in seconds since the previous frame
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_SetFrameTime(float time,
+													   float delta_time);
+
+	/**
+	 * Returns the current per-frame parameters.
+	 */
+	extern BLZAPIENTRY struct BLZ_FrameData BLZAPICALL BLZ_GetFrameData();
+
+	/**
+	 * Creates a buffer for the uniform block with the specified name. The
+	 * block is connected to every shader which declares it, including the
+	 * ones compiled before. The block should use the std140 layout.
+	 * @param block_name Name of the uniform block in GLSL code
+	 * @param size Size of the block in bytes
+	 * @returns Uniform buffer or NULL on failure
+	 */
+	extern BLZAPIENTRY struct BLZ_UniformBuffer BLZAPICALL *BLZ_CreateUniformBuffer(
+		const char *block_name,
+		size_t size);
+
+	/**
+	 * Updates the specified part of a uniform buffer with one upload.
+	 * The new values are used by the draws made after this call.
+	 * @param buffer The uniform buffer
+	 * @param data Pointer to the new values
+	 * @param offset Offset in bytes from the start of the block
+	 * @param size Size of the updated part in bytes
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_UpdateUniformBuffer(
+		struct BLZ_UniformBuffer *buffer,
+		const void *data,
+		size_t offset,
+		size_t size);
+
+	/**
+	 * Frees the specified uniform buffer.
+	 */
+	extern BLZAPIENTRY int BLZAPICALL BLZ_FreeUniformBuffer(
+		struct BLZ_UniformBuffer *buffer);
+
+	/** @} */
+
 	/** \addtogroup image Image loading
      * Allows to load textures from files and memory. Powered by SOIL
 	 * (Simple OpenGL Image Library).
@@ -734,7 +1683,13 @@ extern "C"
 		DDS_LOAD_DIRECT = 64,
 		NTSC_SAFE_RGB = 128,
 		CoCg_Y = 256,
-		TEXTURE_RECTANGLE = 512
+		TEXTURE_RECTANGLE = 512,
+		/**
+		 * Crops the image to the bounding box of its non-transparent pixels.
+		 * The drawing functions which take a source rectangle treat the
+		 * texture as if it wasn't cropped, see \ref BLZ_Texture.
+		 */
+		TRIM_ALPHA = 1024
 	};
 
 	/**
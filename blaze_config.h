@@ -0,0 +1,113 @@
+/* Build configuration of the Blaze library */
+#ifndef _BLAZE_CONFIG_H
+#define _BLAZE_CONFIG_H
+
+/*
+ * Uncomment or pass -D BLZ_CONFIG_STATIC to the compiler to build the library
+ * without dynamic memory allocation. All of the objects are taken from the
+ * static pools which are sized using the limits below, so the memory usage
+ * is known at compile time. Every limit can be overridden with -D.
+ *
+ * Two things are still not fixed at compile time:
+ * - SOIL loads and saves the images using buffers from the C library malloc,
+ *   calloc and free, which are released before the call returns
+ * - the limits of a dynamic batch are the ones it was created with, so the
+ *   loops over its buckets and sprites are bounded by the batch fields and
+ *   the limits below only size the storage
+ */
+/* #define BLZ_CONFIG_STATIC */
+
+#ifdef BLZ_CONFIG_STATIC
+/* Maximum count of dynamic sprite batches */
+#ifndef BLZ_MAX_BATCHES
+#define BLZ_MAX_BATCHES 2
+#endif
+/* Maximum count of buckets (textures) per dynamic batch */
+#ifndef BLZ_MAX_BUCKETS
+#define BLZ_MAX_BUCKETS 8
+#endif
+/* Maximum count of sprites per bucket of a dynamic batch */
+#ifndef BLZ_MAX_SPRITES_PER_BUCKET
+#define BLZ_MAX_SPRITES_PER_BUCKET 1024
+#endif
+/* Maximum count of custom vertex channels of dynamic batches, every bucket
+ * reserves the memory for them, 0 disables the channels. The opaque batches
+ * need one more float per vertex, which fits if this is at least 1 */
+#ifndef BLZ_MAX_CHANNELS
+#define BLZ_MAX_CHANNELS 0
+#endif
+/* Maximum count of static sprite batches */
+#ifndef BLZ_MAX_STATIC_BATCHES
+#define BLZ_MAX_STATIC_BATCHES 4
+#endif
+/* Maximum count of sprites per static batch */
+#ifndef BLZ_MAX_STATIC_SPRITES
+#define BLZ_MAX_STATIC_SPRITES 1024
+#endif
+/* Maximum count of grid cells per static batch created with a cell size */
+#ifndef BLZ_MAX_STATIC_CELLS
+#define BLZ_MAX_STATIC_CELLS 256
+#endif
+/* Maximum count of shaders, including the default one */
+#ifndef BLZ_MAX_SHADERS
+#define BLZ_MAX_SHADERS 8
+#endif
+/* Maximum count of uniforms per shader with cached locations and values,
+ * the other ones are looked up and set directly */
+#ifndef BLZ_MAX_UNIFORMS
+#define BLZ_MAX_UNIFORMS 16
+#endif
+/* Maximum count of loaded textures, not including the render targets */
+#ifndef BLZ_MAX_TEXTURES
+#define BLZ_MAX_TEXTURES 64
+#endif
+/* Maximum count of render targets */
+#ifndef BLZ_MAX_RENDER_TARGETS
+#define BLZ_MAX_RENDER_TARGETS 4
+#endif
+/* Maximum count of render queues */
+#ifndef BLZ_MAX_RENDER_QUEUES
+#define BLZ_MAX_RENDER_QUEUES 1
+#endif
+/* Maximum count of commands per render queue */
+#ifndef BLZ_MAX_QUEUE_COMMANDS
+#define BLZ_MAX_QUEUE_COMMANDS 256
+#endif
+/* Maximum count of sprites per render queue, up to 16384 */
+#ifndef BLZ_MAX_QUEUE_SPRITES
+#define BLZ_MAX_QUEUE_SPRITES 4096
+#endif
+/* Size of the buffer for shader compilation logs, longer logs are truncated */
+#ifndef BLZ_SHADER_LOG_SIZE
+#define BLZ_SHADER_LOG_SIZE 1024
+#endif
+/* Size of the buffer for the defines of a shader variant, including the
+ * terminating zero of every define */
+#ifndef BLZ_VARIANT_DEFINES_SIZE
+#define BLZ_VARIANT_DEFINES_SIZE 256
+#endif
+/* Size of the buffer for program binaries, longer ones are not cached */
+#ifndef BLZ_PROGRAM_BINARY_SIZE
+#define BLZ_PROGRAM_BINARY_SIZE 32768
+#endif
+#endif
+
+/* Maximum count of user uniform buffers in both configurations, the binding
+ * points follow the one of BLZ_FrameData and OpenGL 3.1 guarantees at least
+ * 36 of them */
+#ifndef BLZ_MAX_UNIFORM_BUFFERS
+#define BLZ_MAX_UNIFORM_BUFFERS 15
+#endif
+/* Maximum count of programs which are preloaded from the binary cache by
+ * BLZ_WarmUpShaderCache, in both configurations */
+#ifndef BLZ_MAX_CACHED_PROGRAMS
+#define BLZ_MAX_CACHED_PROGRAMS 64
+#endif
+/* Count of the depth range slices which are given to the presents of the
+ * opaque batches between the clears, the depth buffer is cleared when they
+ * run out. Every slice has 1/BLZ_DEPTH_SLICES of the depth buffer precision */
+#ifndef BLZ_DEPTH_SLICES
+#define BLZ_DEPTH_SLICES 64
+#endif
+
+#endif
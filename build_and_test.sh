@@ -8,6 +8,28 @@ export LD_LIBRARY_PATH=.
 ./test_custom_shader.out
 ./test_multitexturing.out
 ./test_render_target.out
+./test_sprite_defs.out
+./test_allocator.out
+./test_immediate_coalesce.out
+./test_render_queue.out
+./test_uniform_buffers.out
+./test_materials.out
+./test_vertex_channels.out
+./test_premultiplied.out
+./test_shader_cache.out
+./test_async_shader.out
+./test_shader_variants.out
+./test_opaque_sprites.out
+./test_sprite_meshes.out
+./test_alpha_trim.out
+./test_static_cells.out
+./test_static_multitexture.out
+./test_static_updates.out
+./test_static_lean.out
+./test_static_save.out
+./test_static_config.out
+./test_vertex_pages.out
+./test_trim_batch.out
 gcov blaze.c
 geninfo .
 rm -rf docs/coverage/*
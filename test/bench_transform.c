@@ -0,0 +1,94 @@
+#include "common.h"
+
+/*
+*	Measures the BLZ_Draw cost for every combination of optional transform
+*	parameters, using both the specialized transform and the full one.
+*	Build with 'make bench' and run from the repository root.
+*/
+#define SPRITES 10000
+#define ROUNDS 50
+
+#define T_SRC 1
+#define T_ROTATION 2
+#define T_ORIGIN 4
+#define T_SCALE 8
+#define T_FLIP 16
+
+/* defined in blaze.c when it's compiled with BENCHMARK flag */
+extern int BLZ_BenchForceFullTransform;
+
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector2 center = {8, 8};
+struct BLZ_Rectangle texPart = {4, 4, 8, 8};
+struct BLZ_Vector2 scale = {1.5f, 1.5f};
+
+static double measure(struct BLZ_SpriteBatch *batch,
+					  struct BLZ_Texture *texture, int mask)
+{
+	int i, round;
+	Uint64 start, total = 0;
+	struct BLZ_Vector2 position = {0, 0};
+	for (round = 0; round < ROUNDS; round++)
+	{
+		start = SDL_GetPerformanceCounter();
+		for (i = 0; i < SPRITES; i++)
+		{
+			position.x = (float)(i % 512);
+			position.y = (float)(i / 512);
+			BLZ_Draw(batch, texture, position,
+					 (mask & T_SRC) ? &texPart : NULL,
+					 (mask & T_ROTATION) ? 0.5f : 0.0f,
+					 (mask & T_ORIGIN) ? &center : NULL,
+					 (mask & T_SCALE) ? &scale : NULL,
+					 white,
+					 (mask & T_FLIP) ? FLIP_H : NONE);
+		}
+		total += SDL_GetPerformanceCounter() - start;
+		/* not measured, resets the batch */
+		BLZ_Present(batch);
+	}
+	return (double)total * 1e9 /
+		   (double)SDL_GetPerformanceFrequency() / (SPRITES * ROUNDS);
+}
+
+int main(int argc, char *argv[])
+{
+	int mask;
+	double specialized, full;
+	struct BLZ_Texture *texture;
+	struct BLZ_SpriteBatch *batch;
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		printf("Could not load texture file!\n");
+		return -1;
+	}
+	batch = BLZ_CreateBatch(1, SPRITES, DEFAULT);
+
+	printf("src rot org scl flip | specialized, ns | full, ns | speedup\n");
+	for (mask = 0; mask <= (T_SRC | T_ROTATION | T_ORIGIN | T_SCALE | T_FLIP); mask++)
+	{
+		BLZ_BenchForceFullTransform = 0;
+		specialized = measure(batch, texture, mask);
+		BLZ_BenchForceFullTransform = 1;
+		full = measure(batch, texture, mask);
+		printf("%3c %3c %3c %3c %4c | %15.2f | %8.2f | %6.2fx\n",
+			   (mask & T_SRC) ? 'x' : '-',
+			   (mask & T_ROTATION) ? 'x' : '-',
+			   (mask & T_ORIGIN) ? 'x' : '-',
+			   (mask & T_SCALE) ? 'x' : '-',
+			   (mask & T_FLIP) ? 'x' : '-',
+			   specialized, full, full / specialized);
+	}
+
+	BLZ_FreeBatch(batch);
+	BLZ_FreeTexture(texture);
+	Test_Shutdown();
+	return 0;
+}
@@ -156,3 +156,105 @@ int Validate_Output(const char *test_name, float likeness)
 	free(actual);
 	return actual_likeness >= likeness;
 }
+
+/* Static scene shared by the static batch tests */
+#define DEGREES(x) ((x)*3.14159265f / 180.0f)
+
+struct BLZ_Vector4 sceneColors[12] = {
+	{1, 0, 0, 1},
+	{0, 1, 0, 1},
+	{0, 0, 1, 1},
+	{1, 1, 0, 1},
+	{0, 1, 1, 1},
+	{1, 0, 1, 1},
+	{1, 0, 0, 0.5f},
+	{0, 1, 0, 0.5f},
+	{0, 0, 1, 0.5f},
+	{1, 1, 0, 0.5f},
+	{0, 1, 1, 0.5f},
+	{1, 0, 1, 0.5f},
+};
+
+/* move 200 pixels down */
+/* matrix is in NDC, so division by window height and multiply by 2 is needed */
+/* the value is also negated because the Y axis goes down instead of up in OpenGL */
+/* matrix is stored in column-major order, following the OpenGL matrix convention */
+GLfloat sceneTransform[16] = {
+	1, 0, 0, 0,
+	0, 1, 0, 0,
+	0, 0, 1, 0,
+	0, 200.0f / -WINDOW_WIDTH * 2.0f, 0, 1
+};
+
+int Load_Scene_Textures(struct BLZ_Texture *textures[2])
+{
+	textures[0] = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	textures[1] = BLZ_LoadTextureFromFile("test/test_texture2.png", AUTO, 0, NONE);
+	return textures[0] != NULL && textures[1] != NULL;
+}
+
+void Draw_Static_Scene(struct BLZ_StaticBatch *batch,
+					   struct BLZ_Texture *texture, float offset_y)
+{
+	int j;
+	struct BLZ_Vector4 white = {1, 1, 1, 1};
+	struct BLZ_Vector2 center = {8, 8}; /* texture center */
+	struct BLZ_Rectangle texPart = {4, 4, 8, 8};
+	struct BLZ_Vector2 scale, position = {20, 20};
+	position.y += offset_y;
+	/* Different rotation angles */
+	for (j = 0; j < 12; j++, position.x += 40)
+	{
+		BLZ_DrawStaticTexture(batch, texture, position, NULL,
+							  DEGREES(30.0f * j), NULL, NULL, white, NONE);
+	}
+	position.x = 20;
+	position.y += 40;
+	/* Different colors */
+	for (j = 0; j < 12; j++, position.x += 40)
+	{
+		BLZ_DrawStaticTexture(batch, texture, position, NULL, 0, NULL, NULL,
+							  sceneColors[j], NONE);
+	}
+	position.x = 20;
+	position.y += 40;
+	/* Rotate around specified origin */
+	for (j = 0; j < 12; j++, position.x += 40)
+	{
+		BLZ_DrawStaticTexture(batch, texture, position, NULL,
+							  DEGREES(30.0f * j), &center, NULL, white, NONE);
+	}
+	position.x = 20;
+	position.y += 40;
+	/* Draw only specified part using different scales */
+	for (j = 0; j < 12; j++, position.x += 40)
+	{
+		scale.x = j / 6.0f;
+		scale.y = j / 6.0f;
+		BLZ_DrawStaticTexture(batch, texture, position, &texPart, 0.0f, NULL,
+							  &scale, white, NONE);
+	}
+	position.x = 20;
+	position.y += 40;
+	/* Do various flips */
+	for (j = 0; j < 4; j++, position.x += 40)
+	{
+		BLZ_DrawStaticTexture(batch, texture, position, NULL, 0.0f, NULL, NULL,
+							  white, (enum BLZ_SpriteFlip)(j % 4));
+	}
+}
+
+void Present_Static_Scene(struct BLZ_StaticBatch *first,
+						  struct BLZ_StaticBatch *second)
+{
+	struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	BLZ_Clear();
+	BLZ_PresentStatic(first, NULL);
+	if (second != NULL)
+	{
+		BLZ_PresentStatic(second, (GLfloat *)&sceneTransform);
+	}
+	SDL_GL_SwapWindow(window);
+}
@@ -46,4 +46,24 @@ void Test_Shutdown();
 */
 int Validate_Output(const char *test_name, float likeness);
 
+/*
+*	Scene of test_draw_static: rows of sprites with different rotations,
+*	colors, origins, scales and flips. Draw_Static_Scene puts the sprites of
+*	the specified texture into the static batch, moved down by offset_y
+*	pixels. Present_Static_Scene draws one frame with the first batch as is
+*	and the second one (if not NULL) moved down by 200 pixels, which matches
+*	the "test_draw_static" reference when the batches use the textures
+*	loaded by Load_Scene_Textures.
+*/
+#define SCENE_SPRITES 52
+#define SCENE_COLOR_ROW 12
+extern GLfloat sceneTransform[16];
+extern struct BLZ_Vector4 sceneColors[12];
+
+int Load_Scene_Textures(struct BLZ_Texture *textures[2]);
+void Draw_Static_Scene(struct BLZ_StaticBatch *batch,
+					   struct BLZ_Texture *texture, float offset_y);
+void Present_Static_Scene(struct BLZ_StaticBatch *first,
+						  struct BLZ_StaticBatch *second);
+
 #endif
@@ -0,0 +1,82 @@
+#include "common.h"
+
+/* counting allocator which checks that every block is freed */
+static size_t allocated = 0;
+static int calls = 0;
+
+static void *test_alloc(size_t size, void *user_data)
+{
+	calls++;
+	*(int *)user_data += 1;
+	return malloc(size);
+}
+
+static void *test_realloc(void *ptr, size_t size, void *user_data)
+{
+	calls++;
+	return realloc(ptr, size);
+}
+
+static void test_free(void *ptr, void *user_data)
+{
+	*(int *)user_data -= 1;
+	free(ptr);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, live_blocks = 0, calls_before_load;
+	struct BLZ_SpriteBatch *batch;
+	struct BLZ_Texture *texture;
+	struct BLZ_Vector2 position = {0, 0};
+	struct BLZ_Vector4 white = {1, 1, 1, 1};
+	plan(16);
+	ok(!BLZ_SetAllocator(test_alloc, NULL, test_free, &live_blocks),
+	   "fails because of incomplete function set");
+	ok(BLZ_SetAllocator(test_alloc, test_realloc, test_free, &live_blocks),
+	   "custom allocator is set");
+	if (Test_Init() != 0)
+	{
+		BAIL_OUT("Could not initialize test suite");
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	ok(calls > 0, "library allocates through custom allocator");
+	ok(BLZ_GetMemoryUsage(MEMORY_SHADERS) > 0, "default shader is counted");
+	ok(!BLZ_SetAllocator(NULL, NULL, NULL, NULL),
+	   "fails because the memory is in use");
+
+	calls_before_load = calls;
+	texture = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	ok(texture != NULL, "texture loaded");
+	/* the texture object itself is a single allocation */
+	ok(calls - calls_before_load > 1, "SOIL allocates through custom allocator");
+	ok(BLZ_GetMemoryUsage(MEMORY_TEXTURES) > 0, "texture is counted");
+	batch = BLZ_CreateBatch(1, 100, DEFAULT);
+	ok(BLZ_GetMemoryUsage(MEMORY_BATCHES) > 0, "batch is counted");
+	for (i = 0; i < 10; i++)
+	{
+		BLZ_Draw(batch, texture, position, NULL, 0, NULL, NULL, white, NONE);
+	}
+	BLZ_Present(batch);
+	ok(BLZ_GetMemoryUsage(MEMORY_VERTICES) > 0, "vertex pages are counted");
+	BLZ_FreeBatch(batch);
+	ok(BLZ_GetMemoryUsage(MEMORY_BATCHES) == 0, "batch memory is released");
+	BLZ_TrimVertexPool();
+	ok(BLZ_GetMemoryUsage(MEMORY_VERTICES) == 0, "vertex memory is released");
+	BLZ_FreeTexture(texture);
+	ok(BLZ_GetMemoryUsage(MEMORY_TEXTURES) == 0, "texture memory is released");
+
+	for (i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+	{
+		if (i != MEMORY_SHADERS)
+		{
+			allocated += BLZ_GetMemoryUsage((enum BLZ_MemoryCategory)i);
+		}
+	}
+	ok(allocated == 0, "only the default shader memory stays in use");
+	ok(live_blocks > 0, "live blocks are tracked by custom allocator");
+	ok(BLZ_GetMemoryUsage(MEMORY_CATEGORY_COUNT) == 0,
+	   "unknown category has no usage");
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,113 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+/* circle_padded.png is circle_100px.png with 30, 20, 10 and 0 pixels of
+ * transparent padding on the left, top, right and bottom sides */
+struct BLZ_Vector2 origins[3] = {
+	{30, 20},
+	{10, 20}, /* horizontally flipped */
+	{10, 0},  /* flipped both ways */
+};
+/* the circle is symmetric, so the flips don't change the image */
+enum BLZ_SpriteFlip flips[3] = {NONE, FLIP_H, BOTH};
+
+struct BLZ_Texture *texture;
+struct BLZ_Texture *circle;
+
+/* same scene as in test_blend_modes, the padding is compensated by origin */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, const struct BLZ_Vector2 *origins,
+	int x, int y, const struct BLZ_BlendFunc blend)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_SetBlendMode(blend);
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, origins, NULL,
+			 colors[0], flips[0]);
+	position.x += 50;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, origins + 1, NULL,
+			 colors[1], flips[1]);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, origins + 2, NULL,
+			 colors[2], flips[2]);
+	BLZ_Present(batch);
+}
+
+void draw_scene(struct BLZ_SpriteBatch **batches, struct BLZ_Texture *texture,
+				const struct BLZ_Vector2 *origins)
+{
+	int i;
+	BLZ_SetClearColor(clearColor);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batches[0], texture, origins, 50, 50, BLEND_NORMAL);
+		draw(batches[1], texture, origins, 300, 50, BLEND_ADDITIVE);
+		draw(batches[2], texture, origins, 175, 250, BLEND_MULTIPLY);
+		SDL_GL_SwapWindow(window);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_SpriteBatch *batches[3];
+	struct BLZ_Texture filled = {0};
+	struct BLZ_Vector2 no_origins[3] = {{0, 0}, {0, 0}, {0, 0}};
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		batches[i] = BLZ_CreateBatch(2, 100, DEFAULT);
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/circle_padded.png", AUTO, 0,
+									  TRIM_ALPHA);
+	circle = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL || circle == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(5);
+	ok(texture->width == 100 && texture->height == 100,
+	   "texture is cropped to the circle");
+	ok(texture->source_width == 140 && texture->source_height == 120,
+	   "source size is stored");
+	ok(texture->trim_x == 30 && texture->trim_y == 20, "offsets are stored");
+	/* the sprites are placed as if the padding was still there */
+	draw_scene(batches, texture, origins);
+	ok(Validate_Output("test_blend_modes", 0.99f));
+	/* a texture filled by the caller has no source size and isn't trimmed */
+	filled.id = circle->id;
+	filled.width = circle->width;
+	filled.height = circle->height;
+	draw_scene(batches, &filled, no_origins);
+	ok(Validate_Output("test_blend_modes", 0.99f), "filled texture is drawn");
+
+	BLZ_FreeTexture(texture);
+	BLZ_FreeTexture(circle);
+	for (i = 0; i < 3; i++)
+	{
+		BLZ_FreeBatch(batches[i]);
+	}
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,109 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector2 position = { 156, 156 };
+
+/* same shader as in test_custom_shader */
+/* u_mvpMatrix is a model-view-projection matrix which transforms
+ * supplied pixel coordinates into NDC, calculated by BLZ_SetViewport(...)
+ */
+static GLchar vertexSource[] =
+	"#version 130\n"
+	"uniform mat4 u_mvpMatrix;"
+	"in vec2 in_Position;"
+	"in vec2 in_Texcoord;"
+	"in vec4 in_Color;"
+	"out vec4 ex_Color;"
+	"out vec2 ex_Texcoord;"
+	"void main() {"
+	"  ex_Color = in_Color;"
+	"  ex_Texcoord = in_Texcoord;"
+	"  gl_Position = u_mvpMatrix * vec4(in_Position, 1, 1);"
+	"}";
+
+/* sample the texture at passed coordinates, multiply by color specified
+ * in BLZ_Draw(...) and then negate the RGB components
+ */
+static GLchar fragmentSource[] =
+	"#version 130\n"
+	"in vec4 ex_Color;"
+	"in vec2 ex_Texcoord;"
+	"out vec4 outColor;"
+	"uniform sampler2D tex;"
+	"void main() {"
+	"  vec4 color = texture(tex, ex_Texcoord) * ex_Color;"
+	"  outColor = vec4(1 - color.x, 1 - color.y, 1 - color.z, color.w);"
+	"}";
+
+static GLchar invalidSource[] = "this does not compile";
+
+static enum BLZ_ShaderStatus wait_for(struct BLZ_Shader *shader)
+{
+	enum BLZ_ShaderStatus status;
+	while ((status = BLZ_PollShader(shader)) == SHADER_PENDING)
+	{
+		SDL_Delay(1);
+	}
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_Shader *shader, *invalid, *lookup;
+	struct BLZ_Texture *texture;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/jellybeans.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(6);
+	/* both programs are compiled at the same time */
+	shader = BLZ_CompileShaderAsync(vertexSource, fragmentSource);
+	invalid = BLZ_CompileShaderAsync(invalidSource, invalidSource);
+	ok(shader != NULL && invalid != NULL, "compilation is started");
+	ok(wait_for(invalid) == SHADER_FAILED, "invalid shader fails");
+	ok(!BLZ_UseShader(invalid), "failed shader can't be used");
+	/* the first use waits for the compilation */
+	ok(BLZ_UseShader(shader) && BLZ_PollShader(shader) == SHADER_READY,
+	   "pending shader is finished when it's used");
+	/* so does looking up a uniform */
+	lookup = BLZ_CompileShaderAsync(vertexSource, fragmentSource);
+	ok(BLZ_GetUniformLocation(lookup, "u_mvpMatrix") >= 0 &&
+		   BLZ_PollShader(lookup) == SHADER_READY,
+	   "pending shader is finished by uniform lookup");
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		BLZ_DrawImmediate(texture, position, NULL, 0.0f, NULL, NULL, white, NONE);
+		SDL_GL_SwapWindow(window);
+	}
+	/* create a screenshot and compare */
+	ok(Validate_Output("test_custom_shader", 0.999f));
+
+	BLZ_FreeShader(lookup);
+	BLZ_FreeShader(invalid);
+	BLZ_FreeShader(shader);
+	BLZ_FreeTexture(texture);
+	Test_Shutdown();
+	done_testing();
+}
@@ -42,6 +42,7 @@ static GLchar invalidSource[] = "this does not compile";
 int main(int argc, char *argv[])
 {
 	int i;
+	GLint program, location, value;
 	char cwd[255];
 	struct BLZ_Shader *shader;
 	struct BLZ_Texture *texture;
@@ -72,9 +73,24 @@ int main(int argc, char *argv[])
 		BAIL_OUT("Could not use the specified shader!");
 	}
 
-	plan(3);
+	plan(6);
 	ok(BLZ_CompileShader(invalidSource, invalidSource) == NULL);
 	ok(shader != BLZ_GetDefaultShader());
+	/* uniform locations are cached at link time */
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	location = BLZ_GetUniformLocation(shader, "tex");
+	ok(location == glGetUniformLocation((GLuint)program, "tex") && location > -1,
+	   "cached uniform location matches the driver one");
+	/* identical values are not uploaded again */
+	BLZ_Uniform1i(location, 0);
+	glUniform1i(location, 1);
+	BLZ_Uniform1i(location, 0);
+	glGetUniformiv((GLuint)program, location, &value);
+	ok(value == 1, "identical uniform value is skipped");
+	BLZ_InvalidateGLState();
+	BLZ_Uniform1i(location, 0);
+	glGetUniformiv((GLuint)program, location, &value);
+	ok(value == 0, "uniform value is uploaded after state invalidation");
 	/* draw the scene */
 	BLZ_SetClearColor(clearColor);
 	BLZ_SetBlendMode(BLEND_NORMAL);
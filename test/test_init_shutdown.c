@@ -10,7 +10,7 @@ int main(int argc, char *argv[])
 		printf("Could not initialize test suite\n");
 		return -1;
 	}
-	plan(13);
+	plan(15);
 
 	batch = BLZ_CreateBatch(5, 100, DEFAULT);
 	ok(batch != NULL, "initialized with 5, 100");
@@ -25,6 +25,8 @@ int main(int argc, char *argv[])
 	ok(max_tex == 10, "max texture count is 10");
 	ok(max_sprites == 50, "max sprite count per texture is 50");
 	ok(flags == NO_BUFFERING, "specified flags");
+	ok(BLZ_TrimVertexPool(), "freed unused vertex pages");
+	ok(BLZ_InvalidateGLState(), "invalidated cached OpenGL state");
 	ok(BLZ_FreeBatch(batch), "shutdown");
 	ok(!BLZ_GetOptions(batch, &max_tex, &max_sprites, &flags), "fails because not initialized");
 	ok(BLZ_CreateBatch(0, 0, DEFAULT) == NULL, "should not initialize with wrong params");
@@ -0,0 +1,88 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+
+struct BLZ_Texture *texture;
+struct BLZ_Vector2 position = {0, 0};
+
+/* same scene as in test_blend_modes, but drawn by one batch using materials */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, int x, int y,
+	const struct BLZ_Material *material)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 colors[0], NONE);
+	position.x += 50;
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 colors[1], NONE);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 colors[2], NONE);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_SpriteBatch *batch;
+	struct BLZ_Material normal, additive, multiply;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	/* a bucket per material */
+	batch = BLZ_CreateBatch(3, 100, DEFAULT);
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(5);
+	ok(BLZ_InitMaterial(&normal, NULL, BLEND_NORMAL));
+	ok(BLZ_InitMaterial(&additive, NULL, BLEND_ADDITIVE));
+	ok(BLZ_InitMaterial(&multiply, NULL, BLEND_MULTIPLY));
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batch, texture, 50, 50, &normal);
+		draw(batch, texture, 300, 50, &additive);
+		draw(batch, texture, 175, 250, &multiply);
+		BLZ_Present(batch);
+		SDL_GL_SwapWindow(window);
+	}
+	/* create a screenshot and compare */
+	ok(Validate_Output("test_blend_modes", 0.999f));
+	/* buckets are keyed by material, so the fourth one doesn't fit */
+	draw(batch, texture, 0, 0, &normal);
+	draw(batch, texture, 0, 0, &additive);
+	draw(batch, texture, 0, 0, &multiply);
+	ok(!BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[0], NONE),
+	   "sprites without a material need their own bucket");
+	BLZ_Present(batch);
+
+	BLZ_FreeTexture(texture);
+	BLZ_FreeBatch(batch);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,100 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 1};
+struct BLZ_Vector4 red = {1, 0, 0, 1};
+struct BLZ_Vector4 green = {0, 1, 0, 1};
+struct BLZ_Vector4 blue = {0, 0, 1, 0.5f};
+struct BLZ_Vector2 position = {100, 100};
+struct BLZ_Vector2 scale = {4, 4};
+
+struct BLZ_Texture *textures[2];
+
+/* draws two overlapping sprites from different buckets, the second one
+ * should cover the first one although its bucket is drawn first */
+static void draw(struct BLZ_SpriteBatch *batch, int first, int second)
+{
+	BLZ_Draw(batch, textures[first], position, NULL, 0.0f, NULL, &scale, red, NONE);
+	BLZ_Draw(batch, textures[second], position, NULL, 0.0f, NULL, &scale, green, NONE);
+}
+
+static int is_pixel(unsigned char r, unsigned char g, unsigned char b)
+{
+	unsigned char pixel[4];
+	glReadPixels(position.x + 32, WINDOW_HEIGHT - position.y - 32, 1, 1,
+				 GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+	return abs(pixel[0] - r) <= 1 && abs(pixel[1] - g) <= 1 && abs(pixel[2] - b) <= 1;
+}
+
+int main(int argc, char *argv[])
+{
+	char cwd[255];
+	struct BLZ_SpriteBatch *opaque, *translucent;
+	struct BLZ_RenderTarget *target;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	/* same image, but different textures */
+	textures[0] = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	textures[1] = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	if (textures[0] == NULL || textures[1] == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	opaque = BLZ_CreateBatch(2, 16, OPAQUE_SPRITES | NO_BUFFERING);
+	translucent = BLZ_CreateBatch(1, 16, NO_BUFFERING);
+
+	plan(6);
+	ok(opaque != NULL && translucent != NULL);
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	BLZ_Clear();
+	draw(opaque, 0, 1);
+	BLZ_Present(opaque);
+	ok(is_pixel(0, 255, 0), "later sprite covers the earlier one");
+	BLZ_Clear();
+	draw(opaque, 0, 1);
+	BLZ_Draw(opaque, textures[0], position, NULL, 0.0f, NULL, &scale, red, NONE);
+	BLZ_Present(opaque);
+	ok(is_pixel(255, 0, 0), "the closest sprite wins in the first bucket too");
+	/* layers presented one after another keep the painter's order */
+	BLZ_Clear();
+	BLZ_Draw(opaque, textures[1], position, NULL, 0.0f, NULL, &scale, green, NONE);
+	BLZ_Present(opaque);
+	BLZ_Draw(opaque, textures[0], position, NULL, 0.0f, NULL, &scale, red, NONE);
+	BLZ_Present(opaque);
+	ok(is_pixel(255, 0, 0), "later present covers the earlier one");
+	/* render targets have their own depth buffer */
+	target = BLZ_CreateRenderTarget(WINDOW_WIDTH, WINDOW_HEIGHT);
+	BLZ_BindRenderTarget(target);
+	BLZ_Clear();
+	draw(opaque, 0, 1);
+	BLZ_Present(opaque);
+	ok(is_pixel(0, 255, 0), "depth test works in render target");
+	BLZ_BindRenderTarget(NULL);
+	BLZ_FreeRenderTarget(target);
+	BLZ_Clear();
+	draw(opaque, 0, 1);
+	BLZ_Present(opaque);
+	/* translucent sprites are blended over the opaque ones */
+	BLZ_Draw(translucent, textures[0], position, NULL, 0.0f, NULL, &scale, blue, NONE);
+	BLZ_Present(translucent);
+	ok(is_pixel(0, 128, 128), "translucent pass is blended");
+	SDL_GL_SwapWindow(window);
+
+	BLZ_FreeBatch(opaque);
+	BLZ_FreeBatch(translucent);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,87 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+
+struct BLZ_Texture *texture;
+
+/* same scene as in test_blend_modes, normal and additive groups share a draw */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, int x, int y,
+	const struct BLZ_Material *material, float additive)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 BLZ_PremultiplyColor(colors[0], additive), NONE);
+	position.x += 50;
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 BLZ_PremultiplyColor(colors[1], additive), NONE);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_DrawMaterial(batch, material, texture, position, NULL, 0.0f, NULL, NULL,
+					 BLZ_PremultiplyColor(colors[2], additive), NONE);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_SpriteBatch *batch;
+	struct BLZ_Material multiply;
+	struct BLZ_Vector4 half = {1, 0.5f, 0, 0.5f}, color;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	batch = BLZ_CreateBatch(2, 100, DEFAULT);
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	BLZ_SetPremultipliedAlpha(1);
+	texture = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(5);
+	color = BLZ_PremultiplyColor(half, 0.0f);
+	ok(color.x == 0.5f && color.y == 0.25f && color.z == 0 && color.w == 0.5f,
+	   "color channels are multiplied by alpha");
+	color = BLZ_PremultiplyColor(half, 1.0f);
+	ok(color.x == 0.5f && color.y == 0.25f && color.w == 0,
+	   "additive factor zeroes alpha");
+	color = BLZ_PremultiplyColor(half, 2.0f);
+	ok(color.w == 0, "additive factor is clamped");
+	ok(BLZ_InitMaterial(&multiply, NULL, BLEND_MULTIPLY));
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batch, texture, 50, 50, NULL, 0.0f);
+		draw(batch, texture, 300, 50, NULL, 1.0f);
+		/* multiplicative blending still needs a separate state */
+		draw(batch, texture, 175, 250, &multiply, 0.0f);
+		BLZ_Present(batch);
+		SDL_GL_SwapWindow(window);
+	}
+	/* only the antialiased edges differ from the straight alpha output */
+	ok(Validate_Output("test_blend_modes", 0.99f));
+	BLZ_FreeBatch(batch);
+	BLZ_FreeTexture(texture);
+	BLZ_SetPremultipliedAlpha(0);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,252 @@
+#include "common.h"
+#include "unistd.h"
+#include "dirent.h"
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector2 position = { 156, 156 };
+
+/* same shader as in test_custom_shader */
+/* u_mvpMatrix is a model-view-projection matrix which transforms
+ * supplied pixel coordinates into NDC, calculated by BLZ_SetViewport(...)
+ */
+static GLchar vertexSource[] =
+	"#version 130\n"
+	"uniform mat4 u_mvpMatrix;"
+	"in vec2 in_Position;"
+	"in vec2 in_Texcoord;"
+	"in vec4 in_Color;"
+	"out vec4 ex_Color;"
+	"out vec2 ex_Texcoord;"
+	"void main() {"
+	"  ex_Color = in_Color;"
+	"  ex_Texcoord = in_Texcoord;"
+	"  gl_Position = u_mvpMatrix * vec4(in_Position, 1, 1);"
+	"}";
+
+/* sample the texture at passed coordinates, multiply by color specified
+ * in BLZ_Draw(...) and then negate the RGB components
+ */
+static GLchar fragmentSource[] =
+	"#version 130\n"
+	"in vec4 ex_Color;"
+	"in vec2 ex_Texcoord;"
+	"out vec4 outColor;"
+	"uniform sampler2D tex;"
+	"void main() {"
+	"  vec4 color = texture(tex, ex_Texcoord) * ex_Color;"
+	"  outColor = vec4(1 - color.x, 1 - color.y, 1 - color.z, color.w);"
+	"}";
+
+/* finds the program binary written to the cache directory */
+int find_binary(const char *dir, char *path)
+{
+	DIR *files = opendir(dir);
+	struct dirent *entry;
+	int is_found = 0;
+	if (files == NULL)
+	{
+		return 0;
+	}
+	while (!is_found && (entry = readdir(files)) != NULL)
+	{
+		if (strncmp(entry->d_name, "blz_", 4) == 0 &&
+			strstr(entry->d_name, ".bin") != NULL)
+		{
+			sprintf(path, "%s/%s", dir, entry->d_name);
+			is_found = 1;
+		}
+	}
+	closedir(files);
+	return is_found;
+}
+
+/* flips the last bytes of the file, which belong to the binary itself */
+void corrupt_binary(const char *path)
+{
+	int i, c;
+	FILE *file = fopen(path, "r+b");
+	if (file == NULL)
+	{
+		return;
+	}
+	for (i = 1; i <= 16; i++)
+	{
+		fseek(file, -i, SEEK_END);
+		c = fgetc(file);
+		fseek(file, -i, SEEK_END);
+		fputc(~c & 0xFF, file);
+	}
+	fclose(file);
+}
+
+/* offset of the second source hash in the header of the binary */
+#define CHECK_OFFSET 12
+
+int read_byte(const char *path, long offset)
+{
+	int c;
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return EOF;
+	}
+	fseek(file, offset, SEEK_SET);
+	c = fgetc(file);
+	fclose(file);
+	return c;
+}
+
+void flip_byte(const char *path, long offset)
+{
+	int c = read_byte(path, offset);
+	FILE *file = fopen(path, "r+b");
+	if (file == NULL)
+	{
+		return;
+	}
+	fseek(file, offset, SEEK_SET);
+	fputc(~c & 0xFF, file);
+	fclose(file);
+}
+
+void remove_dir(const char *dir)
+{
+	char path[512];
+	DIR *files = opendir(dir);
+	struct dirent *entry;
+	if (files != NULL)
+	{
+		while ((entry = readdir(files)) != NULL)
+		{
+			if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			{
+				sprintf(path, "%s/%s", dir, entry->d_name);
+				remove(path);
+			}
+		}
+		closedir(files);
+	}
+	rmdir(dir);
+}
+
+int count_lines(const char *path)
+{
+	int c, count = 0;
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+	{
+		return 0;
+	}
+	while ((c = fgetc(file)) != EOF)
+	{
+		count += c == '\n';
+	}
+	fclose(file);
+	return count;
+}
+
+/* compiles the shader again after preloading the cache, the program is taken
+ * from the cache if its binary isn't written again */
+int is_cached(const char *dir)
+{
+	char path[512];
+	struct BLZ_Shader *shader;
+	int is_saved;
+	if (!BLZ_WarmUpShaderCache() || !find_binary(dir, path))
+	{
+		return 0;
+	}
+	remove(path);
+	shader = BLZ_CompileShader(vertexSource, fragmentSource);
+	is_saved = find_binary(dir, path);
+	BLZ_FreeShader(shader);
+	return shader != NULL && !is_saved;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, is_available, check = EOF;
+	char cwd[255];
+	char dir[] = "/tmp/blz_cache_XXXXXX";
+	char binary[512], index[512];
+	struct BLZ_Shader *shader;
+	struct BLZ_Texture *texture;
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/jellybeans.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	if (mkdtemp(dir) == NULL)
+	{
+		BAIL_OUT("Could not create cache directory!");
+	}
+	sprintf(index, "%s/blz_index.txt", dir);
+
+	plan(9);
+	ok(!BLZ_SetShaderCacheDir(""));
+	ok(BLZ_SetShaderCacheDir(dir));
+	/* the first compilation stores the binary */
+	shader = BLZ_CompileShader(vertexSource, fragmentSource);
+	ok(shader != NULL, "shader is compiled with the cache enabled");
+	BLZ_FreeShader(shader);
+	is_available = find_binary(dir, binary);
+	diag("program binary cache is %savailable", is_available ? "" : "not ");
+	ok(!is_available || is_cached(dir), "cached program is taken");
+	/* a binary rejected by the driver is replaced by the compiled one */
+	if (is_available)
+	{
+		BLZ_FreeShader(BLZ_CompileShader(vertexSource, fragmentSource));
+		find_binary(dir, binary);
+		corrupt_binary(binary);
+	}
+	shader = BLZ_CompileShader(vertexSource, fragmentSource);
+	ok(shader != NULL && BLZ_UseShader(shader),
+	   "shader is compiled when the binary is rejected");
+	ok(!is_available || is_cached(dir), "rejected binary is replaced");
+	/* the binary of a program with the same hash, but other sources, is
+	 * compiled and written again */
+	if (is_available)
+	{
+		BLZ_FreeShader(BLZ_CompileShader(vertexSource, fragmentSource));
+		find_binary(dir, binary);
+		check = read_byte(binary, CHECK_OFFSET);
+		flip_byte(binary, CHECK_OFFSET);
+		BLZ_FreeShader(BLZ_CompileShader(vertexSource, fragmentSource));
+	}
+	ok(!is_available || read_byte(binary, CHECK_OFFSET) == check,
+	   "binary of another program is not loaded");
+	ok(count_lines(index) == (is_available ? 1 : 0),
+	   "index lists every program once");
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		BLZ_DrawImmediate(texture, position, NULL, 0.0f, NULL, NULL, white, NONE);
+		SDL_GL_SwapWindow(window);
+	}
+	/* create a screenshot and compare */
+	ok(Validate_Output("test_custom_shader", 0.999f));
+
+	BLZ_FreeShader(shader);
+	BLZ_FreeTexture(texture);
+	BLZ_SetShaderCacheDir(NULL);
+	remove_dir(dir);
+	Test_Shutdown();
+	done_testing();
+}
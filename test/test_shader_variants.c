@@ -0,0 +1,96 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+
+struct BLZ_Texture *texture;
+
+/* same scene as in test_blend_modes */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, int x, int y, const struct BLZ_BlendFunc blend)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_SetBlendMode(blend);
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[0], NONE);
+	position.x += 50;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[1], NONE);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[2], NONE);
+	BLZ_Present(batch);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_SpriteBatch *batch;
+	struct BLZ_Shader *shader, *same, *gray, *first, *second;
+	const char *alpha_test[] = {"BLZ_ALPHA_TEST 0.0", "UNUSED", NULL};
+	const char *reordered[] = {"UNUSED", "BLZ_ALPHA_TEST 0.0", NULL};
+	const char *grayscale[] = {"BLZ_GRAYSCALE", NULL};
+	/* these define sets have the same hash */
+	const char *colliding[2][3] = {{"V0", "V3", NULL}, {"V1", "V2", NULL}};
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	batch = BLZ_CreateBatch(2, 100, DEFAULT);
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(6);
+	ok(BLZ_GetDefaultShaderVariant(NULL) == BLZ_GetDefaultShader(),
+	   "variant without defines is the default shader");
+	BLZ_FreeShader(BLZ_GetDefaultShader());
+	shader = BLZ_GetDefaultShaderVariant(alpha_test);
+	same = BLZ_GetDefaultShaderVariant(reordered);
+	ok(shader != NULL && shader == same, "variants are cached by the define set");
+	gray = BLZ_GetDefaultShaderVariant(grayscale);
+	ok(gray != NULL && gray != shader, "other defines give another variant");
+	first = BLZ_GetDefaultShaderVariant(colliding[0]);
+	second = BLZ_GetDefaultShaderVariant(colliding[1]);
+	ok(first != NULL && second != NULL && first != second,
+	   "define sets with the same hash give different variants");
+	/* the alpha test with zero threshold doesn't change the output */
+	ok(BLZ_UseShader(shader));
+	BLZ_SetClearColor(clearColor);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batch, texture, 50, 50, BLEND_NORMAL);
+		draw(batch, texture, 300, 50, BLEND_ADDITIVE);
+		draw(batch, texture, 175, 250, BLEND_MULTIPLY);
+		SDL_GL_SwapWindow(window);
+	}
+	/* create a screenshot and compare */
+	ok(Validate_Output("test_blend_modes", 0.999f));
+
+	BLZ_UseShader(BLZ_GetDefaultShader());
+	BLZ_FreeShader(second);
+	BLZ_FreeShader(first);
+	BLZ_FreeShader(gray);
+	BLZ_FreeShader(same);
+	BLZ_FreeShader(shader);
+	BLZ_FreeTexture(texture);
+	BLZ_FreeBatch(batch);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,96 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+
+struct BLZ_Texture *texture;
+struct BLZ_SpriteMesh mesh;
+
+/* same scene as in test_blend_modes, but drawn using the circle mesh */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, int x, int y, const struct BLZ_BlendFunc blend)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_SetBlendMode(blend);
+	BLZ_DrawMesh(batch, texture, &mesh, position, NULL, 0.0f, NULL, NULL,
+				 colors[0], NONE);
+	position.x += 50;
+	BLZ_DrawMesh(batch, texture, &mesh, position, NULL, 0.0f, NULL, NULL,
+				 colors[1], NONE);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_DrawMesh(batch, texture, &mesh, position, NULL, 0.0f, NULL, NULL,
+				 colors[2], NONE);
+	BLZ_Present(batch);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, inside = 1;
+	GLint alignment;
+	char cwd[255];
+	unsigned char pixels[4 * 4 * 4] = {0};
+	struct BLZ_SpriteBatch *batches[3];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		batches[i] = BLZ_CreateBatch(2, 100, DEFAULT);
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(6);
+	ok(BLZ_BuildSpriteMesh(&mesh, pixels, 4, 4, NULL, 8, 0));
+	ok(mesh.vertex_count == 0, "transparent image gives an empty mesh");
+	glPixelStorei(GL_PACK_ALIGNMENT, 8);
+	ok(BLZ_BuildTextureMesh(&mesh, texture, NULL, 8, 0));
+	glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+	ok(alignment == 8, "pack alignment of the caller is kept");
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	for (i = 0; i < mesh.vertex_count; i++)
+	{
+		inside &= mesh.vertices[i].x >= 0 && mesh.vertices[i].x <= 1 &&
+				  mesh.vertices[i].y >= 0 && mesh.vertices[i].y <= 1;
+	}
+	ok(mesh.vertex_count == 8 && inside, "circle is fitted by an octagon");
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batches[0], texture, 50, 50, BLEND_NORMAL);
+		draw(batches[1], texture, 300, 50, BLEND_ADDITIVE);
+		draw(batches[2], texture, 175, 250, BLEND_MULTIPLY);
+		SDL_GL_SwapWindow(window);
+	}
+	/* only the transparent corners are skipped */
+	ok(Validate_Output("test_blend_modes", 0.99f));
+
+	BLZ_FreeTexture(texture);
+	for (i = 0; i < 3; i++)
+	{
+		BLZ_FreeBatch(batches[i]);
+	}
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,59 @@
+#include "common.h"
+
+struct BLZ_Texture *textures[2];
+
+/* the scene with some sprites out of the screen */
+void draw(struct BLZ_StaticBatch *batch, struct BLZ_Texture *texture)
+{
+	int j;
+	struct BLZ_Vector4 white = {1, 1, 1, 1};
+	struct BLZ_Vector2 offscreen = {-1000, -1000};
+	/* culled, these cells are outside of the screen */
+	for (j = 0; j < 8; j++)
+	{
+		BLZ_DrawStatic(batch, offscreen, NULL, 0, NULL, NULL, white, NONE);
+		offscreen.x += WINDOW_WIDTH + 1000;
+	}
+	Draw_Static_Scene(batch, texture, 0);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+	struct BLZ_StaticBatch *batches[2];
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!Load_Scene_Textures(textures))
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	/* small cells to split the scene rows */
+	batches[0] = BLZ_CreateStaticEx(textures[0], SCENE_SPRITES + 8, 64,
+									STATIC_DEFAULT);
+	batches[1] = BLZ_CreateStaticEx(textures[1], SCENE_SPRITES + 8, 64,
+									STATIC_DEFAULT);
+
+	plan(3);
+	ok(batches[0] != NULL && batches[1] != NULL);
+	ok(BLZ_CreateStaticEx(textures[0], 60, -1, STATIC_DEFAULT) == NULL,
+	   "negative cell size is rejected");
+	draw(batches[0], textures[0]);
+	draw(batches[1], textures[1]);
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(batches[0], batches[1]);
+	}
+	/* only the visible cells are drawn, the result should not change */
+	ok(Validate_Output("test_draw_static", 0.999f));
+
+	BLZ_FreeBatchStatic(batches[0]);
+	BLZ_FreeBatchStatic(batches[1]);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
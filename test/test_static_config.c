@@ -0,0 +1,72 @@
+#include "common.h"
+
+/* built against the library compiled with BLZ_CONFIG_STATIC */
+#ifndef BLZ_CONFIG_STATIC
+#error "test_static_config must be compiled with BLZ_CONFIG_STATIC"
+#endif
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Texture *textures[2];
+struct BLZ_SpriteBatch *batch;
+
+int draw(struct BLZ_Texture *texture, float x, float y)
+{
+	struct BLZ_Vector2 position;
+	position.x = x;
+	position.y = y;
+	return BLZ_Draw(batch, texture, position, NULL, 0, NULL, NULL, white, NONE);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, max_buckets, max_sprites, drawn;
+	enum BLZ_InitFlags flags;
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	textures[0] = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	textures[1] = BLZ_LoadTextureFromFile("test/test_texture2.png", AUTO, 0, NONE);
+	if (textures[0] == NULL || textures[1] == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(7);
+	/* the compile-time maxima can't be exceeded */
+	ok(BLZ_CreateBatch(BLZ_MAX_BUCKETS + 1, 4, DEFAULT) == NULL);
+	ok(BLZ_CreateBatch(1, BLZ_MAX_SPRITES_PER_BUCKET + 1, DEFAULT) == NULL);
+
+	/* but a batch keeps the lower limits it was created with */
+	batch = BLZ_CreateBatch(1, 4, DEFAULT);
+	if (batch == NULL)
+	{
+		BAIL_OUT("Could not create batch!");
+	}
+	ok(BLZ_GetOptions(batch, &max_buckets, &max_sprites, &flags) &&
+	   max_buckets == 1 && max_sprites == 4);
+	drawn = 0;
+	for (i = 0; i < 8; i++)
+	{
+		drawn += draw(textures[0], 20 + 40 * i, 20);
+	}
+	ok(drawn == 4, "the bucket is full after 4 sprites");
+	ok(!draw(textures[1], 20, 60), "there is no second bucket");
+
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	BLZ_Clear();
+	ok(BLZ_Present(batch));
+	SDL_GL_SwapWindow(window);
+	/* the bucket is empty again after presenting */
+	ok(draw(textures[1], 20, 60));
+
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	BLZ_FreeBatch(batch);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,47 @@
+#include "common.h"
+
+struct BLZ_Texture *textures[2];
+
+int main(int argc, char *argv[])
+{
+	int i;
+	struct BLZ_Vector2 recolored = {20, 60};
+	struct BLZ_StaticBatch *batches[2];
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!Load_Scene_Textures(textures))
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	batches[0] = BLZ_CreateStaticEx(textures[0], SCENE_SPRITES, 0, QUANTIZED);
+	batches[1] = BLZ_CreateStaticEx(textures[1], SCENE_SPRITES, 0,
+									DISCARD_CPU_COPY | QUANTIZED);
+
+	plan(4);
+	ok(batches[0] != NULL && batches[1] != NULL, "batches are created");
+	Draw_Static_Scene(batches[0], textures[0], 0);
+	Draw_Static_Scene(batches[1], textures[1], 0);
+	Present_Static_Scene(batches[0], batches[1]);
+	/* the batch without CPU copy uploads the changes immediately */
+	ok(BLZ_ReplaceStatic(batches[1], SCENE_COLOR_ROW, textures[1], recolored,
+						 NULL, 0, NULL, NULL, sceneColors[1], NONE));
+	ok(BLZ_ReplaceStatic(batches[1], SCENE_COLOR_ROW, textures[1], recolored,
+						 NULL, 0, NULL, NULL, sceneColors[0], NONE));
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(batches[0], batches[1]);
+	}
+	/* the rotated sprites have their corners rounded to whole pixels */
+	ok(Validate_Output("test_draw_static", 0.99f));
+
+	BLZ_FreeBatchStatic(batches[0]);
+	BLZ_FreeBatchStatic(batches[1]);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
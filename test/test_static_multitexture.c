@@ -0,0 +1,43 @@
+#include "common.h"
+
+struct BLZ_Texture *textures[2];
+
+int main(int argc, char *argv[])
+{
+	int i;
+	struct BLZ_Vector2 position = {20, 20};
+	struct BLZ_Vector4 white = {1, 1, 1, 1};
+	struct BLZ_StaticBatch *batch;
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!Load_Scene_Textures(textures))
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	/* a single batch without default texture holds both textures */
+	batch = BLZ_CreateStatic(NULL, SCENE_SPRITES * 2);
+
+	plan(3);
+	ok(batch != NULL);
+	/* the second texture is moved down instead of the transform */
+	Draw_Static_Scene(batch, textures[0], 0);
+	Draw_Static_Scene(batch, textures[1], 200);
+	ok(!BLZ_DrawStatic(batch, position, NULL, 0, NULL, NULL, white, NONE),
+	   "default texture is required for BLZ_DrawStatic");
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(batch, NULL);
+	}
+	/* the output should be identical to the one of two batches */
+	ok(Validate_Output("test_draw_static", 0.999f));
+
+	BLZ_FreeBatchStatic(batch);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,84 @@
+#include "common.h"
+
+struct BLZ_Texture *textures[2];
+
+int main(int argc, char *argv[])
+{
+	int i, saved = 1;
+	const char *paths[3] = {"test_static_save0.bin", "test_static_save1.bin",
+							"test_static_save2.bin"};
+	const struct BLZ_Texture *both[2];
+	struct BLZ_StaticBatch *batches[2], *mixed;
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!Load_Scene_Textures(textures))
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	batches[0] = BLZ_CreateStaticEx(textures[0], SCENE_SPRITES, 64,
+									STATIC_DEFAULT);
+	batches[1] = BLZ_CreateStaticEx(textures[1], SCENE_SPRITES, 0,
+									DISCARD_CPU_COPY);
+
+	plan(6);
+	/* the batches are saved without being presented */
+	Draw_Static_Scene(batches[0], textures[0], 0);
+	Draw_Static_Scene(batches[1], textures[1], 0);
+	for (i = 0; i < 2; i++)
+	{
+		saved &= BLZ_SaveStatic(batches[i], paths[i]);
+		BLZ_FreeBatchStatic(batches[i]);
+	}
+	ok(saved, "batches are saved");
+	ok(BLZ_LoadStatic("test/test_texture.png", textures[0]) == NULL,
+	   "invalid file is rejected");
+	batches[0] = BLZ_LoadStatic(paths[0], textures[0]);
+	batches[1] = BLZ_LoadStatic(paths[1], textures[1]);
+	ok(batches[0] != NULL && batches[1] != NULL, "batches are loaded");
+	if (batches[0] == NULL || batches[1] == NULL)
+	{
+		BAIL_OUT("Could not load static batch file!");
+	}
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(batches[0], batches[1]);
+	}
+	/* the output should be identical to the drawn scene */
+	ok(Validate_Output("test_draw_static", 0.999f));
+
+	/* the uploaded sprites of a single texture become the first cell when
+	 * the second texture is appended, its bounds are saved too */
+	mixed = BLZ_CreateStatic(textures[0], SCENE_SPRITES * 2);
+	Draw_Static_Scene(mixed, textures[0], 0);
+	Present_Static_Scene(mixed, NULL);
+	Draw_Static_Scene(mixed, textures[1], 200);
+	ok(BLZ_SaveStatic(mixed, paths[2]), "mixed batch is saved after upload");
+	BLZ_FreeBatchStatic(mixed);
+	both[0] = textures[0];
+	both[1] = textures[1];
+	mixed = BLZ_LoadStaticEx(paths[2], both, 2);
+	if (mixed == NULL)
+	{
+		BAIL_OUT("Could not load mixed static batch file!");
+	}
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(mixed, NULL);
+	}
+	ok(Validate_Output("test_draw_static", 0.999f));
+
+	remove(paths[0]);
+	remove(paths[1]);
+	remove(paths[2]);
+	BLZ_FreeBatchStatic(batches[0]);
+	BLZ_FreeBatchStatic(batches[1]);
+	BLZ_FreeBatchStatic(mixed);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,93 @@
+#include "common.h"
+
+#define DEGREES(x) ((x)*3.14159265f / 180.0f)
+
+struct BLZ_Texture *textures[2];
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+
+/* sprites of the first two scene rows, the first range is contiguous and
+ * the others are scattered, so they don't fit into the dirty range table */
+int edited[] = {19, 20, 21, 22, 23, 0, 2, 4, 6, 8, 10, 12, 14, 16};
+#define EDITED_COUNT (int)(sizeof(edited) / sizeof(edited[0]))
+
+/* replaces the sprite with the one of the scene */
+int restore(struct BLZ_StaticBatch *batch, int index)
+{
+	struct BLZ_Vector2 position;
+	position.x = 20 + 40 * (index % 12);
+	position.y = 20 + 40 * (index / 12);
+	if (index < 12)
+	{
+		return BLZ_ReplaceStatic(batch, index, textures[0], position, NULL,
+								 DEGREES(30.0f * index), NULL, NULL, white,
+								 NONE);
+	}
+	return BLZ_ReplaceStatic(batch, index, textures[0], position, NULL, 0,
+							 NULL, NULL, sceneColors[index - 12], NONE);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, hidden = 1, restored = 1;
+	struct BLZ_Vector2 middle = {248, 248};
+	struct BLZ_Vector2 recolored = {20, 60};
+	struct BLZ_StaticBatch *batches[2];
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	if (!Load_Scene_Textures(textures))
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	batches[0] = BLZ_CreateStatic(textures[0], SCENE_SPRITES + 4);
+	batches[1] = BLZ_CreateStatic(textures[1], SCENE_SPRITES);
+
+	plan(5);
+	/* the scene and some extra sprites which are hidden later */
+	Draw_Static_Scene(batches[0], textures[0], 0);
+	for (i = 0; i < 4; i++)
+	{
+		BLZ_DrawStatic(batches[0], middle, NULL, 0, NULL, NULL, white, NONE);
+	}
+	Present_Static_Scene(batches[0], batches[1]);
+	/* change the uploaded batch */
+	for (i = SCENE_SPRITES; i < SCENE_SPRITES + 4; i++)
+	{
+		hidden &= BLZ_HideStatic(batches[0], i);
+	}
+	ok(!BLZ_HideStatic(batches[0], SCENE_SPRITES + 4), "index is validated");
+	Present_Static_Scene(batches[0], batches[1]);
+	/* each one is uploaded separately */
+	for (i = 0; i < EDITED_COUNT; i++)
+	{
+		hidden &= BLZ_HideStatic(batches[0], edited[i]);
+		Present_Static_Scene(batches[0], batches[1]);
+	}
+	ok(hidden, "sprites are hidden");
+	/* the first sprite of the color row is changed twice between presents */
+	ok(BLZ_ReplaceStatic(batches[0], SCENE_COLOR_ROW, textures[0], recolored,
+						 NULL, 0, NULL, NULL, sceneColors[1], NONE));
+	for (i = 0; i < EDITED_COUNT; i++)
+	{
+		restored &= restore(batches[0], edited[i]);
+	}
+	ok(restored, "hidden sprites are restored");
+	/* the second batch is filled after its upload */
+	Draw_Static_Scene(batches[1], textures[1], 0);
+	for (i = 0; i < 5; i++)
+	{
+		Present_Static_Scene(batches[0], batches[1]);
+	}
+	/* the output should be identical to the unchanged scene */
+	ok(Validate_Output("test_draw_static", 0.999f));
+
+	BLZ_FreeBatchStatic(batches[0]);
+	BLZ_FreeBatchStatic(batches[1]);
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	Test_Shutdown();
+	done_testing();
+}
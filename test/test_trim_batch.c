@@ -0,0 +1,85 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0.5f, 0.5f, 0.5f, 0};
+struct BLZ_Vector4 colors[3] = {
+	{1, 0, 0, 1.0f},
+	{0, 1, 0, 1.0f},
+	{0, 0, 1, 1.0f},
+};
+
+struct BLZ_Texture *texture;
+
+/* same scene as in test_blend_modes */
+void draw(
+	struct BLZ_SpriteBatch *batch,
+	struct BLZ_Texture *texture, int x, int y, const struct BLZ_BlendFunc blend)
+{
+	struct BLZ_Vector2 position = {x, y};
+	BLZ_SetBlendMode(blend);
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[0], NONE);
+	position.x += 50;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[1], NONE);
+	position.x -= 25;
+	position.y += 25;
+	BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, colors[2], NONE);
+	BLZ_Present(batch);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, j, is_trimmed = 1;
+	char cwd[255];
+	struct BLZ_SpriteBatch *batches[3];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	for (i = 0; i < 3; i++)
+	{
+		batches[i] = BLZ_CreateBatch(2, 100, DEFAULT);
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/circle_100px.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+
+	plan(6);
+	ok(BLZ_TrimBatch(batches[0], 0), "trimmed never used buckets");
+	ok(BLZ_Present(batches[0]), "presented empty batch");
+	ok(!BLZ_TrimBatch(batches[0], -1), "fails because of negative idle frame count");
+	ok(!BLZ_TrimBatch(NULL, 0), "fails because of missing batch");
+	/* the buckets are released after every frame and created again */
+	BLZ_SetClearColor(clearColor);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		draw(batches[0], texture, 50, 50, BLEND_NORMAL);
+		draw(batches[1], texture, 300, 50, BLEND_ADDITIVE);
+		draw(batches[2], texture, 175, 250, BLEND_MULTIPLY);
+		SDL_GL_SwapWindow(window);
+		for (j = 0; j < 3; j++)
+		{
+			is_trimmed = BLZ_TrimBatch(batches[j], 0) && is_trimmed;
+		}
+	}
+	ok(is_trimmed, "trimmed used buckets");
+	ok(Validate_Output("test_blend_modes", 0.999f));
+
+	BLZ_FreeTexture(texture);
+	for (i = 0; i < 3; i++)
+	{
+		BLZ_FreeBatch(batches[i]);
+	}
+	Test_Shutdown();
+	done_testing();
+}
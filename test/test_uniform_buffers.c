@@ -0,0 +1,110 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector2 position = {156, 156};
+
+/* same color negate shader as in test_custom_shader, but the projection and
+ * the tint color are taken from the uniform blocks */
+static GLchar vertexSource[] =
+	"#version 140\n"
+	"layout(std140) uniform BLZ_FrameData {"
+	"  mat4 projection;"
+	"  vec2 resolution;"
+	"  float time;"
+	"  float delta_time;"
+	"};"
+	"in vec2 in_Position;"
+	"in vec2 in_Texcoord;"
+	"in vec4 in_Color;"
+	"out vec4 ex_Color;"
+	"out vec2 ex_Texcoord;"
+	"void main() {"
+	"  ex_Color = in_Color;"
+	"  ex_Texcoord = in_Texcoord;"
+	"  gl_Position = projection * vec4(in_Position, 1, 1);"
+	"}";
+
+static GLchar fragmentSource[] =
+	"#version 140\n"
+	"layout(std140) uniform Params {"
+	"  vec4 tint;"
+	"};"
+	"in vec4 ex_Color;"
+	"in vec2 ex_Texcoord;"
+	"out vec4 outColor;"
+	"uniform sampler2D tex;"
+	"void main() {"
+	"  vec4 color = texture(tex, ex_Texcoord) * ex_Color * tint;"
+	"  outColor = vec4(1 - color.x, 1 - color.y, 1 - color.z, color.w);"
+	"}";
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_Shader *shader;
+	struct BLZ_Texture *texture;
+	struct BLZ_UniformBuffer *params;
+	struct BLZ_FrameData frame;
+	GLfloat black[4] = {0, 0, 0, 1};
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/jellybeans.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	shader = BLZ_CompileShader(vertexSource, fragmentSource);
+	if (shader == NULL)
+	{
+		BAIL_OUT("Could not compile shader!");
+	}
+
+	plan(7);
+	ok(BLZ_SetFrameTime(2.0f, 0.5f));
+	frame = BLZ_GetFrameData();
+	ok(frame.resolution[0] == WINDOW_WIDTH && frame.resolution[1] == WINDOW_HEIGHT &&
+		   frame.time == 2.0f && frame.delta_time == 0.5f,
+	   "frame data is filled");
+	/* the block is connected to the shaders compiled before */
+	params = BLZ_CreateUniformBuffer("Params", sizeof(black));
+	ok(params != NULL);
+	ok(!BLZ_UpdateUniformBuffer(params, black, 4, sizeof(black)),
+	   "update out of bounds fails");
+	ok(BLZ_UpdateUniformBuffer(params, black, 0, sizeof(black)));
+	ok(BLZ_UpdateUniformBuffer(params, &white, 0, sizeof(white)));
+	if (!BLZ_UseShader(shader))
+	{
+		BAIL_OUT("Could not use the specified shader!");
+	}
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		BLZ_DrawImmediate(texture, position, NULL, 0.0f, NULL, NULL, white, NONE);
+		SDL_GL_SwapWindow(window);
+	}
+	/* the output should be identical to test_custom_shader */
+	ok(Validate_Output("test_custom_shader", 0.999f));
+
+	BLZ_UseShader(BLZ_GetDefaultShader());
+	BLZ_FreeShader(shader);
+	BLZ_FreeUniformBuffer(params);
+	BLZ_FreeTexture(texture);
+	Test_Shutdown();
+	done_testing();
+}
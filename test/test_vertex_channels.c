@@ -0,0 +1,100 @@
+#include "common.h"
+#include "unistd.h"
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector2 position = {156, 156};
+
+/* color negate shader from test_custom_shader, the negation amount is
+ * passed per sprite using the first custom channel */
+static GLchar vertexSource[] =
+	"#version 130\n"
+	"uniform mat4 u_mvpMatrix;"
+	"in vec2 in_Position;"
+	"in vec2 in_Texcoord;"
+	"in vec4 in_Color;"
+	"in vec4 in_Channel0;"
+	"out vec4 ex_Color;"
+	"out vec2 ex_Texcoord;"
+	"out float ex_Amount;"
+	"void main() {"
+	"  ex_Color = in_Color;"
+	"  ex_Texcoord = in_Texcoord;"
+	"  ex_Amount = in_Channel0.x;"
+	"  gl_Position = u_mvpMatrix * vec4(in_Position, 1, 1);"
+	"}";
+
+static GLchar fragmentSource[] =
+	"#version 130\n"
+	"in vec4 ex_Color;"
+	"in vec2 ex_Texcoord;"
+	"in float ex_Amount;"
+	"out vec4 outColor;"
+	"uniform sampler2D tex;"
+	"void main() {"
+	"  vec4 color = texture(tex, ex_Texcoord) * ex_Color;"
+	"  outColor = vec4(mix(color.xyz, 1 - color.xyz, ex_Amount), color.w);"
+	"}";
+
+int main(int argc, char *argv[])
+{
+	int i;
+	char cwd[255];
+	struct BLZ_Shader *shader;
+	struct BLZ_Texture *texture;
+	struct BLZ_SpriteBatch *batch;
+	GLfloat channels[4] = {1, 0, 0, 0};
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	texture = BLZ_LoadTextureFromFile("test/jellybeans.png", AUTO, 0, NONE);
+	if (texture == NULL)
+	{
+		BAIL_OUT("Could not load texture file!");
+	}
+	shader = BLZ_CompileShader(vertexSource, fragmentSource);
+	if (shader == NULL)
+	{
+		BAIL_OUT("Could not compile shader!");
+	}
+	if (!BLZ_UseShader(shader))
+	{
+		BAIL_OUT("Could not use the specified shader!");
+	}
+
+	plan(4);
+	ok(BLZ_CreateBatchEx(1, 10, DEFAULT, 5, CHANNEL_FLOAT) == NULL,
+	   "channel count is limited");
+	batch = BLZ_CreateBatchEx(1, 10, DEFAULT, 1, CHANNEL_UBYTE);
+	ok(batch != NULL);
+	/* draw the scene */
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		BLZ_Clear();
+		BLZ_DrawEx(batch, NULL, texture, position, NULL, 0.0f, NULL, NULL,
+				   white, NONE, channels);
+		BLZ_Present(batch);
+		SDL_GL_SwapWindow(window);
+	}
+	ok(BLZ_GetLastError() == NULL);
+	/* the output should be identical to test_custom_shader */
+	ok(Validate_Output("test_custom_shader", 0.999f));
+
+	BLZ_UseShader(BLZ_GetDefaultShader());
+	BLZ_FreeBatch(batch);
+	BLZ_FreeShader(shader);
+	BLZ_FreeTexture(texture);
+	Test_Shutdown();
+	done_testing();
+}
@@ -0,0 +1,148 @@
+#include "common.h"
+#include "unistd.h"
+
+/* sprites in a vertex page of the default size (64 KB) */
+#define PAGE_SPRITES 512
+
+struct BLZ_Vector4 clearColor = {0, 0, 0, 0};
+struct BLZ_Vector4 colors[12] = {
+	{1, 0, 0, 1},
+	{0, 1, 0, 1},
+	{0, 0, 1, 1},
+	{1, 1, 0, 1},
+	{0, 1, 1, 1},
+	{1, 0, 1, 1},
+	{1, 0, 0, 0.5f},
+	{0, 1, 0, 0.5f},
+	{0, 0, 1, 0.5f},
+	{1, 1, 0, 0.5f},
+	{0, 1, 1, 0.5f},
+	{1, 0, 1, 0.5f},
+};
+
+#define DEGREES(x) ((x)*3.14159265f / 180.0f)
+#define MoveRight()       \
+	do                    \
+	{                     \
+		position.x += 40; \
+	} while (0);
+#define NextLine()        \
+	do                    \
+	{                     \
+		position.x = 20;  \
+		position.y += 40; \
+	} while (0);
+
+struct BLZ_Texture *textures[2];
+struct BLZ_Vector4 white = {1, 1, 1, 1};
+struct BLZ_Vector4 invisible = {1, 1, 1, 0};
+struct BLZ_Vector2 startPosition = {20, 20};
+struct BLZ_Vector2 position;
+struct BLZ_Vector2 center = {8, 8}; /* texture center */
+struct BLZ_Rectangle texPart = {4, 4, 8, 8};
+struct BLZ_Vector2 scale = {1, 1};
+struct BLZ_SpriteBatch *batch;
+
+/* same scene as in test_draw_dynamic */
+void draw(struct BLZ_Texture *texture)
+{
+	int j;
+	for (j = 0; j < 12; j++)
+	{
+		BLZ_Draw(batch, texture, position, NULL, DEGREES(30.0f * j), NULL, NULL, white, NONE);
+		MoveRight();
+	}
+	NextLine();
+	for (j = 0; j < 12; j++)
+	{
+		BLZ_Draw(batch, texture, position, NULL, 0, NULL, NULL, colors[j], NONE);
+		MoveRight();
+	}
+	NextLine();
+	for (j = 0; j < 12; j++)
+	{
+		BLZ_Draw(batch, texture, position, NULL, DEGREES(30.0f * j), &center, NULL, white, NONE);
+		MoveRight();
+	}
+	NextLine();
+	for (j = 0; j < 12; j++)
+	{
+		scale.x = j / 6.0f;
+		scale.y = j / 6.0f;
+		BLZ_Draw(batch, texture, position, &texPart, 0.0f, NULL, &scale, white, NONE);
+		MoveRight();
+	}
+	NextLine();
+	for (j = 0; j < 4; j++)
+	{
+		BLZ_Draw(batch, texture, position, NULL, 0.0f, NULL, NULL, white,
+				 (enum BLZ_SpriteFlip)(j % 4));
+		MoveRight();
+	}
+	NextLine();
+	NextLine();
+}
+
+/* transparent sprites which don't change the output, the scene after them
+ * starts near the end of the first page and continues on the second one */
+int fill(struct BLZ_Texture *texture)
+{
+	int i, drawn = 0;
+	for (i = 0; i < PAGE_SPRITES - 20; i++)
+	{
+		drawn += BLZ_Draw(batch, texture, startPosition, NULL, 0, NULL, NULL,
+						  invisible, NONE);
+	}
+	return drawn == PAGE_SPRITES - 20;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, is_filled = 1;
+	char cwd[255];
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+	{
+		printf("Could not get current directory - getcwd fail\n");
+		return -1;
+	}
+	printf("Current working dir: %s\n", cwd);
+	if (Test_Init() != 0)
+	{
+		printf("Could not initialize test suite\n");
+		return -1;
+	}
+	/* every bucket needs two pages */
+	batch = BLZ_CreateBatch(2, PAGE_SPRITES * 2, DEFAULT);
+	BLZ_SetViewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+	textures[0] = BLZ_LoadTextureFromFile("test/test_texture.png", AUTO, 0, NONE);
+	textures[1] = BLZ_LoadTextureFromFile("test/test_texture2.png", AUTO, 0, NONE);
+	if (batch == NULL || textures[0] == NULL || textures[1] == NULL)
+	{
+		BAIL_OUT("Could not create test objects!");
+	}
+
+	plan(3);
+	BLZ_SetClearColor(clearColor);
+	BLZ_SetBlendMode(BLEND_NORMAL);
+	for (i = 0; i < 5; i++)
+	{
+		position = startPosition;
+		BLZ_Clear();
+		is_filled = fill(textures[0]) && is_filled;
+		draw(textures[0]);
+		is_filled = fill(textures[1]) && is_filled;
+		draw(textures[1]);
+		BLZ_Present(batch);
+		SDL_GL_SwapWindow(window);
+	}
+	ok(is_filled, "buckets take more than one page");
+	/* the pages are uploaded one by one, the scene is the same */
+	ok(Validate_Output("test_draw_dynamic", 0.999f));
+	ok(BLZ_TrimVertexPool(), "pages are freed");
+
+	BLZ_FreeTexture(textures[0]);
+	BLZ_FreeTexture(textures[1]);
+	BLZ_FreeBatch(batch);
+	Test_Shutdown();
+	done_testing();
+}